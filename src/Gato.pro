@@ -11,18 +11,19 @@ greaterThan(QT_MAJOR_VERSION, 4): QT += widgets
 TARGET = Gato
 TEMPLATE = app
 
+include(core.pri)
 
 SOURCES	+=  main.cpp \
 	    mainwindow.cpp \
+	    boardwidget.cpp \
 	    client.cpp \
-	    connection.cpp \
-	    peermanager.cpp \
-	    server.cpp
+	    peerdirectory.cpp \
+	    peermanager.cpp
 
 HEADERS  += mainwindow.h \
+	    boardwidget.h \
 	    client.h \
-	    connection.h \
-	    peermanager.h \
-	    server.h
+	    peerdirectory.h \
+	    peermanager.h
 
 FORMS    += mainwindow.ui \
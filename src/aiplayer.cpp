@@ -0,0 +1,393 @@
+#include "aiplayer.h"
+#include "solvedtable.h"
+
+#include <QPair>
+#include <algorithm>
+
+static const int Infinity = 2 * AiPlayer::WinScore;
+static const int MaxPly = GameState::MaxSide * GameState::MaxSide;
+static const int TimeCheckInterval = 1024;
+
+/* Hasta este número de casillas se prueban todas; en tableros más grandes solo las vecinas */
+static const int FullWidthCells = 64;
+
+/* Una victoria a ply jugadas vale WinScore - ply: se prefieren las más rápidas */
+static bool isMateScore(int score)
+{
+    return qAbs(score) > AiPlayer::WinScore - MaxPly;
+}
+
+/* Las victorias se guardan en la tabla relativas a la posición, no a la raíz */
+static int toTable(int score, int ply)
+{
+    if (isMateScore(score))
+        return score > 0 ? score + ply : score - ply;
+    return score;
+}
+
+static int fromTable(int score, int ply)
+{
+    if (isMateScore(score))
+        return score > 0 ? score - ply : score + ply;
+    return score;
+}
+
+/*
+ * Claves de Zobrist: un número aleatorio de 64 bits por casilla y jugador, más
+ * uno para el turno. Se generan con una semilla fija (splitmix64) para que las
+ * búsquedas sean reproducibles entre ejecuciones.
+ */
+static quint64 nextKey(quint64 *state)
+{
+    quint64 z = (*state += Q_UINT64_C(0x9e3779b97f4a7c15));
+    z = (z ^ (z >> 30)) * Q_UINT64_C(0xbf58476d1ce4e5b9);
+    z = (z ^ (z >> 27)) * Q_UINT64_C(0x94d049bb133111eb);
+    return z ^ (z >> 31);
+}
+
+AiPlayer::Stats::Stats()
+{
+    nodes = 0;
+    tableProbes = 0;
+    tableHits = 0;
+    elapsed = 0;
+    depth = 0;
+}
+
+double AiPlayer::Stats::nodesPerSecond() const
+{
+    return elapsed > 0 ? nodes * 1000.0 / elapsed : 0.0;
+}
+
+double AiPlayer::Stats::hitRate() const
+{
+    return tableProbes ? double(tableHits) / tableProbes : 0.0;
+}
+
+AiPlayer::AiPlayer()
+{
+    table.resize(1 << TableBits);
+    clearTable();
+    circleToMove = 0;
+    depthLimit = BOARDSIZE;
+    budget = 0;
+    aborted = false;
+    score = 0;
+}
+
+/*!
+ * Profundidad máxima en medios movimientos. Con el tablero de 3x3 basta con 9
+ * para jugar perfecto; en tableros grandes conviene limitar también el tiempo.
+ */
+void AiPlayer::setMaxDepth(int depth)
+{
+    depthLimit = qBound(1, depth, 127);
+}
+
+int AiPlayer::maxDepth() const
+{
+    return depthLimit;
+}
+
+/*!
+ * Tiempo máximo por jugada en ms; 0 significa sin límite.
+ */
+void AiPlayer::setTimeBudget(int msecs)
+{
+    budget = qMax(0, msecs);
+}
+
+int AiPlayer::timeBudget() const
+{
+    return budget;
+}
+
+void AiPlayer::clearTable()
+{
+    TableEntry empty;
+    empty.key = 0;
+    empty.score = 0;
+    empty.move = 0;
+    empty.depth = -1;
+    empty.bound = Exact;
+    table.fill(empty);
+}
+
+/*!
+ * Regresa la casilla que jugaría la computadora con la marca dada, o -1 si la
+ * partida ya terminó. La tabla se conserva entre jugadas y partidas.
+ */
+int AiPlayer::chooseMove(const GameEngine &engine, GameState::Mark mark)
+{
+    if (mark == GameState::Empty || engine.result() != GameEngine::InProgress)
+        return -1;
+
+    current = Stats();
+    const int empties = engine.cellCount() - engine.moveCount();
+
+    // Con juego perfecto pedido en el 3x3 la respuesta ya está en la tabla resuelta, sin buscar
+    if (engine.isClassic() && depthLimit >= empties) {
+        const quint16 cross = engine.classicMarks(GameState::Cross);
+        const quint16 circle = engine.classicMarks(GameState::Circle);
+        const int index = SolvedTable::index(cross, circle);
+        const bool crossToMove = GameEngine::popCount(cross) == GameEngine::popCount(circle);
+        if (SolvedTable::isValid(index) && crossToMove == (mark == GameState::Cross)) {
+            score = SolvedTable::value(index) * WinScore;
+            current.depth = empties;
+            total.depth = current.depth;
+            return SolvedTable::bestMove(index);
+        }
+    }
+
+    prepare(engine);
+    const int side = mark;
+    quint64 key = side == GameState::Circle ? circleToMove : 0;
+    for (int i = 0; i < position.cellCount(); ++i) {
+        if (position.at(i) != GameState::Empty)
+            key ^= zobrist[position.at(i)].at(i);
+    }
+
+    aborted = false;
+    clock.start();
+
+    int bestMove = -1;
+    const int limit = qMin(depthLimit, empties);
+    for (int depth = 1; depth <= limit; ++depth) {
+        int move = -1;
+        const int value = searchRoot(side, key, depth, &move);
+        if (aborted && bestMove != -1)
+            break;
+        bestMove = move;
+        score = value;
+        current.depth = depth;
+        // Ya se encontró una victoria o derrota forzada, buscar más no la cambia
+        if (aborted || isMateScore(value))
+            break;
+    }
+
+    // Sin tiempo ni para la primera iteración: la primera casilla libre desde el centro
+    for (int n = 0; bestMove == -1 && n < moveOrder.size(); ++n) {
+        if (position.canPlayAt(moveOrder.at(n)))
+            bestMove = moveOrder.at(n);
+    }
+
+    current.elapsed = clock.elapsed();
+    total.nodes += current.nodes;
+    total.tableProbes += current.tableProbes;
+    total.tableHits += current.tableHits;
+    total.elapsed += current.elapsed;
+    total.depth = current.depth;
+    return bestMove;
+}
+
+/*!
+ * Valor de la última jugada elegida desde el punto de vista de la computadora:
+ * positivo si gana, negativo si pierde y cercano a 0 si es empate o no se sabe.
+ */
+int AiPlayer::lastScore() const
+{
+    return score;
+}
+
+const AiPlayer::Stats &AiPlayer::lastSearch() const
+{
+    return current;
+}
+
+/*!
+ * Estadísticas acumuladas de todas las búsquedas.
+ */
+const AiPlayer::Stats &AiPlayer::totals() const
+{
+    return total;
+}
+
+/*!
+ * Copia el tablero y, si cambiaron las dimensiones, rehace las claves y el orden de jugadas.
+ */
+void AiPlayer::prepare(const GameEngine &engine)
+{
+    if (engine.rows() != position.rows() || engine.columns() != position.columns()
+            || zobrist[0].size() != engine.cellCount()) {
+        const int cells = engine.cellCount();
+        quint64 seed = Q_UINT64_C(0x9e3779b97f4a7c15);
+        for (int side = 0; side < 2; ++side) {
+            zobrist[side].resize(cells);
+            for (int i = 0; i < cells; ++i)
+                zobrist[side][i] = nextKey(&seed);
+        }
+        circleToMove = nextKey(&seed);
+
+        // Del centro hacia afuera; en el 3x3 queda centro, esquinas y lados
+        const int rows = engine.rows(), columns = engine.columns();
+        QVector<QPair<int, int> > byDistance;
+        for (int i = 0; i < cells; ++i) {
+            const int dr = 2 * (i / columns) - (rows - 1);
+            const int dc = 2 * (i % columns) - (columns - 1);
+            byDistance.append(qMakePair(dr * dr + dc * dc, i));
+        }
+        std::stable_sort(byDistance.begin(), byDistance.end());
+        moveOrder.resize(cells);
+        for (int i = 0; i < cells; ++i)
+            moveOrder[i] = byDistance.at(i).second;
+        clearTable();
+    }
+    position = engine;
+}
+
+bool AiPlayer::hasNeighbour(int pos) const
+{
+    const int columns = position.columns();
+    const int r = pos / columns, c = pos % columns;
+    for (int nr = qMax(0, r - 1); nr <= qMin(position.rows() - 1, r + 1); ++nr) {
+        for (int nc = qMax(0, c - 1); nc <= qMin(columns - 1, c + 1); ++nc) {
+            if (position.at(nr * columns + nc) != GameState::Empty)
+                return true;
+        }
+    }
+    return false;
+}
+
+/*!
+ * Jugadas a probar: la de la tabla primero y luego del centro hacia afuera.
+ */
+void AiPlayer::generateMoves(MoveList *moves, int hint) const
+{
+    const bool fullWidth = position.cellCount() <= FullWidthCells || position.moveCount() == 0;
+    if (hint >= 0 && position.canPlayAt(hint))
+        moves->append(hint);
+    for (int n = 0; n < moveOrder.size(); ++n) {
+        const int pos = moveOrder.at(n);
+        if (pos != hint && position.canPlayAt(pos) && (fullWidth || hasNeighbour(pos)))
+            moves->append(pos);
+    }
+}
+
+int AiPlayer::searchRoot(int side, quint64 key, int depth, int *bestMove)
+{
+    const TableEntry &entry = table.at(key & (table.size() - 1));
+    MoveList moves;
+    generateMoves(&moves, entry.key == key ? entry.move - 1 : -1);
+
+    int alpha = -Infinity;
+    *bestMove = -1;
+    for (int n = 0; n < moves.size(); ++n) {
+        const int pos = moves.at(n);
+        position.play(pos, GameState::Mark(side));
+        const int value = -search(side ^ 1, key ^ zobrist[side].at(pos) ^ circleToMove,
+                                  depth - 1, 1, -Infinity, -alpha);
+        position.undo(pos);
+        if (aborted)
+            break;
+        if (value > alpha || *bestMove == -1) {
+            alpha = value;
+            *bestMove = pos;
+        }
+    }
+    return alpha;
+}
+
+int AiPlayer::search(int side, quint64 key, int depth, int ply, int alpha, int beta)
+{
+    ++current.nodes;
+    if ((current.nodes % TimeCheckInterval) == 0 && outOfTime())
+        return 0;
+
+    // Solo puede haber ganado quien acaba de jugar
+    const GameEngine::Result result = position.result();
+    if (result == GameEngine::CrossWon || result == GameEngine::CircleWon)
+        return -(WinScore - ply);
+    if (result == GameEngine::Draw)
+        return 0;
+    if (depth <= 0)
+        return evaluate(side);
+
+    TableEntry &entry = table[key & (table.size() - 1)];
+    int hint = -1;
+    ++current.tableProbes;
+    if (entry.key == key) {
+        ++current.tableHits;
+        hint = entry.move - 1;
+        if (entry.depth >= depth) {
+            const int value = fromTable(entry.score, ply);
+            if (entry.bound == Exact)
+                return value;
+            if (entry.bound == Lower)
+                alpha = qMax(alpha, value);
+            else
+                beta = qMin(beta, value);
+            if (alpha >= beta)
+                return value;
+        }
+    }
+
+    MoveList moves;
+    generateMoves(&moves, hint);
+
+    const int originalAlpha = alpha;
+    int best = -Infinity;
+    int bestMove = -1;
+    for (int n = 0; n < moves.size(); ++n) {
+        const int pos = moves.at(n);
+        position.play(pos, GameState::Mark(side));
+        const int value = -search(side ^ 1, key ^ zobrist[side].at(pos) ^ circleToMove,
+                                  depth - 1, ply + 1, -beta, -alpha);
+        position.undo(pos);
+        if (aborted)
+            return 0;
+
+        if (value > best) {
+            best = value;
+            bestMove = pos;
+        }
+        if (best > alpha)
+            alpha = best;
+        if (alpha >= beta)
+            break;
+    }
+
+    entry.key = key;
+    entry.score = toTable(best, ply);
+    entry.depth = qint8(depth);
+    entry.move = quint16(bestMove + 1);
+    entry.bound = best <= originalAlpha ? Upper : best >= beta ? Lower : Exact;
+    return best;
+}
+
+/*!
+ * Evaluación al llegar al límite de profundidad: cada tramo de winLength casillas
+ * que un jugador todavía puede completar suma el cuadrado de las marcas que lleva.
+ */
+int AiPlayer::evaluate(int side) const
+{
+    static const int Steps[4][2] = { { 0, 1 }, { 1, 0 }, { 1, 1 }, { 1, -1 } };
+
+    const int rows = position.rows(), columns = position.columns();
+    const int k = position.winLength();
+    int value = 0;
+    for (int d = 0; d < 4; ++d) {
+        const int dr = Steps[d][0], dc = Steps[d][1];
+        for (int r = 0; r < rows; ++r) {
+            for (int c = 0; c < columns; ++c) {
+                const int er = r + dr * (k - 1), ec = c + dc * (k - 1);
+                if (er >= rows || ec < 0 || ec >= columns)
+                    continue;
+                int counts[3] = { 0, 0, 0 };
+                for (int i = 0; i < k; ++i)
+                    ++counts[position.at((r + dr * i) * columns + c + dc * i)];
+                if (!counts[side ^ 1])
+                    value += counts[side] * counts[side];
+                else if (!counts[side])
+                    value -= counts[side ^ 1] * counts[side ^ 1];
+            }
+        }
+    }
+    return value;
+}
+
+bool AiPlayer::outOfTime()
+{
+    if (budget > 0 && clock.elapsed() >= budget)
+        aborted = true;
+    return aborted;
+}
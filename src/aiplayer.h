@@ -0,0 +1,86 @@
+#ifndef AIPLAYER_H
+#define AIPLAYER_H
+
+#include <QElapsedTimer>
+#include <QVarLengthArray>
+#include <QVector>
+#include "gameengine.h"
+
+/*
+ * Oponente de la computadora: negamax con poda alfa-beta, profundización
+ * iterativa y tabla de transposición indexada con claves de Zobrist.
+ * La búsqueda se corta al llegar a la profundidad máxima o al agotar el
+ * presupuesto de tiempo; en ese caso se usa la mejor jugada de la última
+ * iteración completa. No depende de la interfaz, así que también sirve para
+ * jugar partidas entre bots sin ventana. En tableros grandes solo se prueban
+ * las casillas vecinas a alguna marca.
+ */
+class AiPlayer
+{
+public:
+    struct Stats {
+        Stats();
+
+        quint64 nodes;
+        quint64 tableProbes;
+        quint64 tableHits;
+        qint64 elapsed;     // ms
+        int depth;          // última profundidad completada
+
+        double nodesPerSecond() const;
+        double hitRate() const;
+    };
+
+    static const int TableBits = 16;
+    // Mayor que cualquier evaluate(): 4 direcciones x 255x255 tramos x 32^2 < 2^28 - MaxPly
+    static const int WinScore = 1 << 28;
+
+    AiPlayer();
+
+    void setMaxDepth(int depth);
+    int maxDepth() const;
+    void setTimeBudget(int msecs);
+    int timeBudget() const;
+    void clearTable();
+
+    int chooseMove(const GameEngine &engine, GameState::Mark mark);
+    int lastScore() const;
+    const Stats &lastSearch() const;
+    const Stats &totals() const;
+
+private:
+    enum Bound { Exact, Lower, Upper };
+
+    struct TableEntry {
+        quint64 key;
+        qint32 score;
+        quint16 move;       // casilla + 1; 0 si no hay
+        qint8 depth;
+        quint8 bound;
+    };
+
+    typedef QVarLengthArray<int, 256> MoveList;
+
+    void prepare(const GameEngine &engine);
+    void generateMoves(MoveList *moves, int hint) const;
+    bool hasNeighbour(int pos) const;
+    int searchRoot(int side, quint64 key, int depth, int *bestMove);
+    int search(int side, quint64 key, int depth, int ply, int alpha, int beta);
+    int evaluate(int side) const;
+    bool outOfTime();
+
+    QVector<TableEntry> table;
+    QVector<quint64> zobrist[2];
+    quint64 circleToMove;
+    QVector<int> moveOrder;     // casillas del centro hacia afuera
+    GameEngine position;
+    int depthLimit;
+    int budget;
+    bool aborted;
+    int score;
+    QElapsedTimer clock;
+    Stats current;
+    Stats total;
+};
+
+#endif
@@ -0,0 +1,25 @@
+#-------------------------------------------------
+#
+# Microbenchmarks del protocolo, el codec del estado y el motor del juego
+#
+#-------------------------------------------------
+
+QT	+= core network testlib
+QT	-= gui
+
+TARGET = GatoBench
+CONFIG	+= console
+CONFIG	-= app_bundle
+TEMPLATE = app
+
+include(../core.pri)
+
+INCLUDEPATH += ../dedicated
+DEPENDPATH += ../dedicated
+
+SOURCES	+=  benchmarks.cpp \
+	    ../dedicated/gameserver.cpp \
+	    ../dedicated/gamesession.cpp
+
+HEADERS  += ../dedicated/gameserver.h \
+	    ../dedicated/gamesession.h
@@ -0,0 +1,1111 @@
+#include <QtTest>
+#include <QtNetwork>
+
+#include "connection.h"
+#include "connectionregistry.h"
+#include "discoveryschedule.h"
+#include "framescanner.h"
+#include "gameengine.h"
+#include "gameserver.h"
+#include "gamejournal.h"
+#include "gamestate.h"
+#include "metrics.h"
+#include "outgoingframe.h"
+#include "server.h"
+#include "solvedtable.h"
+#include "timerwheel.h"
+
+#ifdef Q_OS_UNIX
+#include <sys/resource.h>
+#endif
+
+#if QT_VERSION >= 0x050000
+#define SKIP_BENCHMARK(message) QSKIP(message)
+#else
+#define SKIP_BENCHMARK(message) QSKIP(message, SkipSingle)
+#endif
+
+/*
+ * Los resultados que no se miden con QBENCHMARK se reportan con
+ * QTest::setBenchmarkResult(), que existe desde Qt 4.7; así salen en -csv y
+ * -xml como los demás. QTest::BytesAllocated existe solo desde Qt 5.
+ */
+#if QT_VERSION >= 0x040700
+#define REPORT_RESULT(value, metric) QTest::setBenchmarkResult(value, metric)
+#else
+#define REPORT_RESULT(value, metric) Q_UNUSED(value)
+#endif
+#if QT_VERSION >= 0x050000
+#define MEMORY_METRIC QTest::BytesAllocated
+#else
+#define MEMORY_METRIC QTest::Events
+#endif
+
+/*
+ * Microbenchmarks de las rutas calientes, sin interfaz gráfica.
+ * Uso: GatoBench [-csv | -xml | -o archivo,formato] [-iterations N] [prueba]
+ * Con -csv o -xml los resultados salen en un formato que se puede comparar
+ * entre versiones (ver la ayuda de QTest, GatoBench -help).
+ */
+class Benchmarks : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void scanWholeFrames_data();
+    void scanWholeFrames();
+    void scanSplitFrames_data();
+    void scanSplitFrames();
+    void scanPipelinedFrames_data();
+    void scanPipelinedFrames();
+
+    void encodeGameState_data();
+    void encodeGameState();
+    void decodeGameState_data();
+    void decodeGameState();
+
+    void winnerAfterLoad_data();
+    void winnerAfterLoad();
+    void winnerAfterPlay_data();
+    void winnerAfterPlay();
+    void solvedTable();
+
+    void fanOut_data();
+    void fanOut();
+
+    void idleConnectionMemory_data();
+    void idleConnectionMemory();
+
+    void registrySharedAddress();
+    void serverUnmatchedClose();
+
+    void timersIdle_data();
+    void timersIdle();
+    void timersRearm_data();
+    void timersRearm();
+
+    void discovery_data();
+    void discovery();
+
+    void journalAppend();
+    void journalVerify();
+
+    void connectionReady();
+    void connectionAccepted(Connection *connection);
+    void timerFired();
+
+private:
+    int readyCount;
+    int firedCount;
+    QList<Connection *> accepted;
+};
+
+/*
+ * Una partida a medias: X y O alternados sin ganador, en el tablero dado.
+ */
+static GameState sampleState(int rows, int columns, int winLength)
+{
+    GameState state(rows, columns, winLength);
+    GameEngine engine(rows, columns, winLength);
+    const int moves = qMin(state.cells.size() - 1, 8 + state.cells.size() / 4);
+    for (int i = 0, pos = 0; i < moves && pos < state.cells.size(); ++pos) {
+        const GameState::Mark mark = i % 2 ? GameState::Circle : GameState::Cross;
+        engine.play(pos, mark);
+        if (engine.result() != GameEngine::InProgress) {
+            engine.undo(pos);
+            continue;
+        }
+        ++i;
+    }
+    engine.store(&state);
+    return state;
+}
+
+static QByteArray sampleFrame(bool binary, quint32 sequence)
+{
+    const GameState state = sampleState(3, 3, 3);
+    return binary ? FrameScanner::binaryFrame(FrameScanner::PackedState, sequence, state.pack())
+                  : FrameScanner::textFrame(FrameScanner::PlainText, state.toText());
+}
+
+/*
+ * Lo que hace Connection::processReadyRead() con cada trama: separarla y decodificar el estado.
+ */
+static int drain(FrameScanner *scanner)
+{
+    FrameScanner::DataType type;
+    QByteArray payload;
+    quint32 sequence;
+    GameState state;
+    int frames = 0;
+    while (scanner->next(&type, &payload, &sequence) == FrameScanner::FrameReady) {
+        if (type == FrameScanner::PackedState)
+            GameState::unpack(payload, &state);
+        else
+            GameState::fromText(payload, &state);
+        ++frames;
+    }
+    return frames;
+}
+
+void Benchmarks::scanWholeFrames_data()
+{
+    QTest::addColumn<bool>("binary");
+    QTest::newRow("texto") << false;
+    QTest::newRow("binario") << true;
+}
+
+void Benchmarks::scanWholeFrames()
+{
+    QFETCH(bool, binary);
+    const QByteArray frame = sampleFrame(binary, 1);
+    FrameScanner scanner;
+    scanner.setBinaryFraming(binary);
+
+    QBENCHMARK {
+        scanner.append(frame);
+        drain(&scanner);
+    }
+}
+
+void Benchmarks::scanSplitFrames_data()
+{
+    QTest::addColumn<bool>("binary");
+    QTest::addColumn<int>("chunk");
+    QTest::newRow("texto/1") << false << 1;
+    QTest::newRow("texto/4") << false << 4;
+    QTest::newRow("binario/1") << true << 1;
+    QTest::newRow("binario/4") << true << 4;
+}
+
+/*
+ * La trama llega partida en pedazos de chunk bytes, como en una red lenta.
+ */
+void Benchmarks::scanSplitFrames()
+{
+    QFETCH(bool, binary);
+    QFETCH(int, chunk);
+    const QByteArray frame = sampleFrame(binary, 1);
+    QList<QByteArray> pieces;
+    for (int i = 0; i < frame.size(); i += chunk)
+        pieces << frame.mid(i, chunk);
+    FrameScanner scanner;
+    scanner.setBinaryFraming(binary);
+
+    QBENCHMARK {
+        foreach (const QByteArray &piece, pieces) {
+            scanner.append(piece);
+            drain(&scanner);
+        }
+    }
+}
+
+/*
+ * Como leía Connection antes de FrameScanner (readDataIntoBuffer()): el tipo y
+ * la longitud byte por byte con read(1) hasta el separador, luego los datos.
+ * Solo existía el protocolo de texto. Es la base contra la que se comparan las
+ * filas de 1 MB de scanPipelinedFrames.
+ */
+static int drainByteAtATime(QIODevice *device)
+{
+    GameState state;
+    QByteArray buffer;
+    int frames = 0;
+    while (device->bytesAvailable() > 0) {
+        int number = 0;
+        for (int field = 0; field < 2; ++field) {
+            buffer.clear();
+            while (device->bytesAvailable() > 0) {
+                buffer.append(device->read(1));
+                if (buffer.endsWith(' '))
+                    break;
+            }
+            if (field == 0 && buffer != "MESSAGE ")
+                return -1;
+            buffer.chop(1);
+            number = buffer.toInt();
+        }
+        GameState::fromText(device->read(number), &state);
+        ++frames;
+    }
+    return frames;
+}
+
+void Benchmarks::scanPipelinedFrames_data()
+{
+    QTest::addColumn<bool>("binary");
+    QTest::addColumn<int>("frames");
+    QTest::addColumn<bool>("byteAtATime");
+    const int megabyte = 1024 * 1024;
+    const int textFrames = megabyte / sampleFrame(false, 1).size() + 1;
+    const int binaryFrames = megabyte / sampleFrame(true, 1).size() + 1;
+    QTest::newRow("texto/256") << false << 256 << false;
+    QTest::newRow("binario/256") << true << 256 << false;
+    QTest::newRow("texto/1MB/byte-a-byte") << false << textFrames << true;
+    QTest::newRow("texto/1MB") << false << textFrames << false;
+    QTest::newRow("binario/1MB") << true << binaryFrames << false;
+}
+
+/*
+ * Muchas tramas juntas en una sola lectura del socket. Las filas de 1 MB
+ * comparan el analizador actual con la lectura byte por byte de antes; las
+ * tramas por segundo son frames entre el tiempo de cada iteración.
+ */
+void Benchmarks::scanPipelinedFrames()
+{
+    QFETCH(bool, binary);
+    QFETCH(int, frames);
+    QFETCH(bool, byteAtATime);
+    QByteArray data;
+    for (int i = 0; i < frames; ++i)
+        data += sampleFrame(binary, i + 1);
+
+    if (byteAtATime) {
+        QBuffer device(&data);
+        QVERIFY(device.open(QIODevice::ReadOnly));
+        QBENCHMARK {
+            device.seek(0);
+            QCOMPARE(drainByteAtATime(&device), frames);
+        }
+        return;
+    }
+
+    FrameScanner scanner;
+    scanner.setBinaryFraming(binary);
+    QBENCHMARK {
+        scanner.append(data);
+        QCOMPARE(drain(&scanner), frames);
+    }
+}
+
+static void addBoardRows()
+{
+    QTest::addColumn<int>("rows");
+    QTest::addColumn<int>("columns");
+    QTest::addColumn<int>("winLength");
+    QTest::addColumn<bool>("packed");
+    QTest::newRow("3x3/texto") << 3 << 3 << 3 << false;
+    QTest::newRow("3x3/binario") << 3 << 3 << 3 << true;
+    QTest::newRow("15x15/texto") << 15 << 15 << 5 << false;
+    QTest::newRow("15x15/binario") << 15 << 15 << 5 << true;
+}
+
+void Benchmarks::encodeGameState_data()
+{
+    addBoardRows();
+}
+
+/*
+ * Lo que hace MainWindow::composeGameState() más la codificación de Connection.
+ */
+void Benchmarks::encodeGameState()
+{
+    QFETCH(int, rows);
+    QFETCH(int, columns);
+    QFETCH(int, winLength);
+    QFETCH(bool, packed);
+    GameEngine engine(rows, columns, winLength);
+    QVERIFY(engine.load(sampleState(rows, columns, winLength)));
+
+    QByteArray data;
+    QBENCHMARK {
+        GameState state(rows, columns, winLength);
+        engine.store(&state);
+        data = packed ? state.pack() : state.toText();
+    }
+    QVERIFY(!data.isEmpty());
+}
+
+void Benchmarks::decodeGameState_data()
+{
+    addBoardRows();
+}
+
+/*
+ * Lo que hace Connection::processData() más MainWindow::appendGameState().
+ */
+void Benchmarks::decodeGameState()
+{
+    QFETCH(int, rows);
+    QFETCH(int, columns);
+    QFETCH(int, winLength);
+    QFETCH(bool, packed);
+    const GameState sample = sampleState(rows, columns, winLength);
+    const QByteArray data = packed ? sample.pack() : sample.toText();
+    GameEngine engine(rows, columns, winLength);
+
+    QBENCHMARK {
+        GameState state;
+        const bool ok = packed ? GameState::unpack(data, &state)
+                               : GameState::fromText(data, &state);
+        if (!ok || !engine.load(state))
+            QFAIL("no se pudo decodificar");
+    }
+}
+
+static void addEngineRows()
+{
+    QTest::addColumn<int>("rows");
+    QTest::addColumn<int>("columns");
+    QTest::addColumn<int>("winLength");
+    QTest::newRow("3x3x3") << 3 << 3 << 3;
+    QTest::newRow("15x15x5") << 15 << 15 << 5;
+    QTest::newRow("64x64x5") << 64 << 64 << 5;
+}
+
+void Benchmarks::winnerAfterLoad_data()
+{
+    addEngineRows();
+}
+
+/*
+ * MainWindow::winner() y checkWinner() después de recibir un tablero: en el 3x3
+ * se lee la tabla resuelta, en los demás se revisa todo el tablero.
+ */
+void Benchmarks::winnerAfterLoad()
+{
+    QFETCH(int, rows);
+    QFETCH(int, columns);
+    QFETCH(int, winLength);
+    const GameState state = sampleState(rows, columns, winLength);
+    GameEngine engine(rows, columns, winLength);
+
+    QBENCHMARK {
+        engine.load(state);
+        engine.setCell(0, GameState::Empty);
+        engine.setCell(0, state.cells.at(0));
+        if (!engine.winningLine().isEmpty() || engine.result() != GameEngine::InProgress)
+            QFAIL("la partida de ejemplo no debería estar terminada");
+    }
+}
+
+void Benchmarks::winnerAfterPlay_data()
+{
+    addEngineRows();
+}
+
+/*
+ * Revisar una jugada recién hecha: solo las cuatro líneas que pasan por ella.
+ */
+void Benchmarks::winnerAfterPlay()
+{
+    QFETCH(int, rows);
+    QFETCH(int, columns);
+    QFETCH(int, winLength);
+    GameEngine engine(rows, columns, winLength);
+    QVERIFY(engine.load(sampleState(rows, columns, winLength)));
+    int pos = engine.cellCount() - 1;
+    while (!engine.canPlayAt(pos))
+        --pos;
+
+    QBENCHMARK {
+        engine.play(pos, GameState::Cross);
+        engine.result();
+        engine.undo(pos);
+    }
+}
+
+/* Las ocho líneas del 3x3 como máscaras de casillas */
+static const quint16 ClassicLines[8] = { 0x007, 0x038, 0x1c0, 0x049, 0x092, 0x124, 0x111, 0x054 };
+
+static bool hasLine(quint16 marks)
+{
+    for (int i = 0; i < 8; ++i) {
+        if ((marks & ClassicLines[i]) == ClassicLines[i])
+            return true;
+    }
+    return false;
+}
+
+/*
+ * Negamax completo, sin memoria ni poda, con el mismo puntaje que
+ * SolvedTable::score(): positivo si gana quien tiene el turno, 1 + casillas
+ * libres al terminar.
+ */
+static int fullNegamax(quint16 cross, quint16 circle)
+{
+    const bool crossToMove = GameEngine::popCount(cross) == GameEngine::popCount(circle);
+    const quint16 empty = quint16(0x1ff & ~(cross | circle));
+    if (hasLine(crossToMove ? circle : cross))
+        return -(GameEngine::popCount(empty) + 1);
+    if (!empty)
+        return 0;
+
+    int best = -BOARDSIZE - 1;
+    for (int pos = 0; pos < BOARDSIZE; ++pos) {
+        const quint16 bit = quint16(1 << pos);
+        if (empty & bit)
+            best = qMax(best, crossToMove ? -fullNegamax(cross | bit, circle)
+                                          : -fullNegamax(cross, circle | bit));
+    }
+    return best;
+}
+
+/* Todas las posiciones a las que se llega jugando desde el tablero vacío */
+static void collectReachable(quint16 cross, quint16 circle, QVector<bool> *seen,
+                             QVector<QPair<quint16, quint16> > *positions)
+{
+    const int index = SolvedTable::index(cross, circle);
+    if (seen->at(index))
+        return;
+    (*seen)[index] = true;
+    *positions << qMakePair(cross, circle);
+
+    const bool crossToMove = GameEngine::popCount(cross) == GameEngine::popCount(circle);
+    if (hasLine(crossToMove ? circle : cross))
+        return;
+    for (int pos = 0; pos < BOARDSIZE; ++pos) {
+        const quint16 bit = quint16(1 << pos);
+        if ((cross | circle) & bit)
+            continue;
+        if (crossToMove)
+            collectReachable(cross | bit, circle, seen, positions);
+        else
+            collectReachable(cross, circle | bit, seen, positions);
+    }
+}
+
+/*
+ * La tabla resuelta al compilar contra un negamax completo en tiempo de
+ * ejecución, en las 5478 posiciones alcanzables: el puntaje de cada una y que
+ * la mejor jugada guardada lo alcance. Las static_assert de solvedtable.cpp
+ * solo pueden revisar unas cuantas posiciones contra la fuerza bruta. Luego
+ * mide la consulta de todas.
+ */
+void Benchmarks::solvedTable()
+{
+    QVector<bool> seen(SolvedTable::Size, false);
+    QVector<QPair<quint16, quint16> > positions;
+    collectReachable(0, 0, &seen, &positions);
+    QCOMPARE(positions.size(), 5478);
+
+    int valid = 0;
+    for (int index = 0; index < SolvedTable::Size; ++index) {
+        if (SolvedTable::isValid(index)) {
+            QVERIFY(seen.at(index));
+            ++valid;
+        }
+    }
+    QCOMPARE(valid, positions.size());
+
+    for (int i = 0; i < positions.size(); ++i) {
+        const quint16 cross = positions.at(i).first, circle = positions.at(i).second;
+        const int index = SolvedTable::index(cross, circle);
+        const int expected = fullNegamax(cross, circle);
+        QCOMPARE(SolvedTable::score(index), expected);
+
+        const bool crossToMove = GameEngine::popCount(cross) == GameEngine::popCount(circle);
+        const bool over = hasLine(crossToMove ? circle : cross) || (cross | circle) == 0x1ff;
+        QCOMPARE(SolvedTable::isTerminal(index), over);
+        const int move = SolvedTable::bestMove(index);
+        if (over) {
+            QCOMPARE(move, -1);
+            continue;
+        }
+        QVERIFY(move >= 0 && move < BOARDSIZE && !((cross | circle) & (1 << move)));
+        const quint16 bit = quint16(1 << move);
+        QCOMPARE(crossToMove ? -fullNegamax(cross | bit, circle)
+                             : -fullNegamax(cross, circle | bit), expected);
+    }
+
+    int sum = 0;
+    QBENCHMARK {
+        for (int i = 0; i < positions.size(); ++i) {
+            const int index = SolvedTable::index(positions.at(i).first, positions.at(i).second);
+            sum += SolvedTable::score(index) + SolvedTable::bestMove(index);
+        }
+    }
+    Q_UNUSED(sum);
+}
+
+void Benchmarks::fanOut_data()
+{
+    QTest::addColumn<int>("connections");
+    QTest::addColumn<bool>("shared");
+    QTest::newRow("1/por-conexion") << 1 << false;
+    QTest::newRow("1/compartido") << 1 << true;
+    QTest::newRow("64/por-conexion") << 64 << false;
+    QTest::newRow("64/compartido") << 64 << true;
+    QTest::newRow("512/por-conexion") << 512 << false;
+    QTest::newRow("512/compartido") << 512 << true;
+}
+
+/*
+ * Connection::sendGameState()/sendFrame(): el mismo estado a muchas conexiones reales
+ * por loopback, codificándolo una vez por conexión o una sola vez (OutgoingFrame).
+ * Cada iteración espera a que los datos salgan, así la cola de escritura no crece.
+ */
+void Benchmarks::fanOut()
+{
+    QFETCH(int, connections);
+    QFETCH(bool, shared);
+
+    Server server;
+    QVERIFY(server.isListening());
+    readyCount = 0;
+    QList<Connection *> clients;
+    for (int i = 0; i < connections; ++i) {
+        Connection *connection = new Connection(this);
+        connection->setGreetingMessage("bench");
+        connect(connection, SIGNAL(readyForUse()), this, SLOT(connectionReady()));
+        connection->connectToHost(QHostAddress::LocalHost, server.serverPort());
+        clients << connection;
+    }
+    for (int waited = 0; readyCount < connections && waited < 10000; waited += 10)
+        QTest::qWait(10);
+    QCOMPARE(readyCount, connections);
+
+    const GameState state = sampleState(3, 3, 3);
+    QBENCHMARK {
+        if (shared) {
+            OutgoingFrame frame(state);
+            foreach (Connection *connection, clients)
+                connection->sendFrame(frame);
+        } else {
+            foreach (Connection *connection, clients)
+                connection->sendGameState(state);
+        }
+        foreach (Connection *connection, clients)
+            connection->flushOutput();
+    }
+
+    qDeleteAll(clients);
+}
+
+void Benchmarks::idleConnectionMemory_data()
+{
+    QTest::addColumn<int>("connections");
+    // La unidad va en el nombre: en Qt 4 la columna no dice bytes
+    QTest::newRow("1000/bytes-por-10k") << 1000;
+    QTest::newRow("10000/bytes-por-10k") << 10000;
+}
+
+/*
+ * Sube el límite de descriptores de archivo para tener count abiertos a la vez.
+ */
+static bool raiseFileLimit(int count)
+{
+#ifdef Q_OS_UNIX
+    struct rlimit limit;
+    if (getrlimit(RLIMIT_NOFILE, &limit) != 0)
+        return false;
+    if (limit.rlim_cur >= rlim_t(count))
+        return true;
+    if (limit.rlim_max < rlim_t(count))
+        return false;
+    limit.rlim_cur = count;
+    return setrlimit(RLIMIT_NOFILE, &limit) == 0;
+#else
+    Q_UNUSED(count);
+    return true;
+#endif
+}
+
+/*
+ * Memoria residente por cada 10 mil conexiones ociosas, ya con el saludo hecho.
+ * Ambos extremos de cada conexión por loopback viven en este proceso, así que
+ * la diferencia se reparte entre 2 conexiones por par. El resultado se reporta
+ * en bytes por 10 mil conexiones.
+ */
+void Benchmarks::idleConnectionMemory()
+{
+    QFETCH(int, connections);
+    if (!raiseFileLimit(2 * connections + 64))
+        SKIP_BENCHMARK("No hay suficientes descriptores de archivo");
+
+    Server server;
+    QVERIFY(server.isListening());
+    QTest::qWait(10);
+    const qint64 before = Metrics::residentMemory();
+    if (!before)
+        SKIP_BENCHMARK("El sistema no reporta la memoria residente");
+
+    readyCount = 0;
+    QList<Connection *> clients;
+    for (int i = 0; i < connections; ++i) {
+        Connection *connection = new Connection(this);
+        connection->setGreetingMessage("bench");
+        connect(connection, SIGNAL(readyForUse()), this, SLOT(connectionReady()));
+        connection->connectToHost(QHostAddress::LocalHost, server.serverPort());
+        clients << connection;
+    }
+    for (int waited = 0; readyCount < connections && waited < 60000; waited += 10)
+        QTest::qWait(10);
+    QCOMPARE(readyCount, connections);
+
+    // Deja que se liberen los buffers de las lecturas del saludo
+    QTest::qWait(100);
+    const qint64 after = Metrics::residentMemory();
+    const double perTenThousand = double(after - before) / (2 * connections) * 10000;
+    REPORT_RESULT(perTenThousand, MEMORY_METRIC);
+
+    qDeleteAll(clients);
+}
+
+/*
+ * Dos nodos en la misma dirección (varias instancias en un equipo o detrás de
+ * un NAT) se conectan a un tercero. Sus conexiones salen de puertos efímeros,
+ * pero el registro del tercero las guarda con el puerto de servidor que
+ * anuncian en el saludo, el mismo que tiene el directorio por sus datagramas.
+ * Mide la búsqueda por (dirección, puerto) con ambas registradas.
+ */
+void Benchmarks::registrySharedAddress()
+{
+    static const quint16 ListenPorts[2] = { 45101, 45102 };
+
+    Server server;
+    QVERIFY(server.isListening());
+    connect(&server, SIGNAL(newConnection(Connection*)),
+            this, SLOT(connectionAccepted(Connection*)));
+    readyCount = 0;
+    accepted.clear();
+    QList<Connection *> clients;
+    for (int i = 0; i < 2; ++i) {
+        Connection *connection = new Connection(this);
+        connection->setGreetingMessage("bench");
+        connection->setServerPort(ListenPorts[i]);
+        connect(connection, SIGNAL(readyForUse()), this, SLOT(connectionReady()));
+        connection->connectToHost(QHostAddress::LocalHost, server.serverPort());
+        clients << connection;
+    }
+    for (int waited = 0; readyCount < 4 && waited < 10000; waited += 10)
+        QTest::qWait(10);
+    QCOMPARE(readyCount, 4);
+    QCOMPARE(accepted.size(), 2);
+
+    ConnectionRegistry registry;
+    foreach (Connection *connection, accepted)
+        QVERIFY(registry.insert(connection));
+    const QHostAddress address = accepted.first()->peerAddress();
+    QCOMPARE(accepted.last()->peerAddress(), address);
+    for (int i = 0; i < 2; ++i) {
+        Connection *connection = registry.find(address, ListenPorts[i]);
+        QVERIFY(connection);
+        QCOMPARE(connection->peerPort(), clients.at(i)->localPort());
+        QVERIFY(!registry.contains(address, clients.at(i)->localPort()));
+    }
+
+    // Al irse uno, el otro nodo en la misma dirección sigue registrado
+    QVERIFY(registry.remove(registry.find(address, ListenPorts[0])));
+    QVERIFY(!registry.contains(address, ListenPorts[0]));
+    QVERIFY(registry.contains(address, ListenPorts[1]));
+
+    bool found = false;
+    QBENCHMARK {
+        found = registry.contains(address, ListenPorts[1]);
+    }
+    QVERIFY(found);
+
+    qDeleteAll(clients);
+}
+
+/*
+ * Clientes que se van antes de tener partida: unos después de saludar, ya en la
+ * cola de espera, y otros de golpe, algunos antes de saludar y otros ya
+ * emparejados. Al final el servidor dedicado no debe contar ninguna conexión.
+ * Luego mide conectar y cerrar un cliente que no llega a jugar.
+ */
+void Benchmarks::serverUnmatchedClose()
+{
+    static const int Waiting = 20;
+    static const int Burst = 100;
+
+    GameServer server(0);
+    QVERIFY(server.isListening());
+    server.setWorkerThreads(2);
+
+    for (int i = 0; i < Waiting; ++i) {
+        Connection client;
+        client.setGreetingMessage("bench");
+        client.connectToHost(QHostAddress::LocalHost, server.serverPort());
+        for (int waited = 0; server.connectionCount() < 1 && waited < 5000; waited += 5)
+            QTest::qWait(5);
+        QCOMPARE(server.connectionCount(), 1);
+        QTest::qWait(20);
+        client.abort();
+        for (int waited = 0; server.connectionCount() > 0 && waited < 5000; waited += 5)
+            QTest::qWait(5);
+        QCOMPARE(server.connectionCount(), 0);
+    }
+
+    QList<Connection *> clients;
+    for (int i = 0; i < Burst; ++i) {
+        Connection *client = new Connection;
+        client->setGreetingMessage("bench");
+        client->connectToHost(QHostAddress::LocalHost, server.serverPort());
+        clients << client;
+        if (i % 2)
+            QTest::qWait(1);
+    }
+    QTest::qWait(50);
+    foreach (Connection *client, clients)
+        client->abort();
+    qDeleteAll(clients);
+    for (int waited = 0; (server.connectionCount() > 0 || server.sessionCount() > 0)
+                         && waited < 10000; waited += 10)
+        QTest::qWait(10);
+    QCOMPARE(server.connectionCount(), 0);
+    QCOMPARE(server.sessionCount(), 0);
+
+    QBENCHMARK {
+        Connection client;
+        client.setGreetingMessage("bench");
+        client.connectToHost(QHostAddress::LocalHost, server.serverPort());
+        for (int waited = 0; server.connectionCount() < 1 && waited < 5000; ++waited)
+            QTest::qWait(1);
+        client.abort();
+        for (int waited = 0; server.connectionCount() > 0 && waited < 5000; ++waited)
+            QTest::qWait(1);
+    }
+    QCOMPARE(server.connectionCount(), 0);
+}
+
+void Benchmarks::discovery_data()
+{
+    QTest::addColumn<int>("nodes");
+    QTest::addColumn<int>("counter");
+    const int counts[] = { 10, 50, 100, 200, 400 };
+    const char *counters[] = { "enviados", "recibidos", "intentos" };
+    for (int i = 0; i < 5; ++i) {
+        for (int c = 0; c < 3; ++c) {
+            const QByteArray name = QByteArray::number(counts[i]) + '/' + counters[c];
+            QTest::newRow(name.constData()) << counts[i] << c;
+        }
+    }
+}
+
+/*
+ * Simula nodes instancias en una misma red con las reglas de DiscoverySchedule
+ * y un reloj virtual: cada anuncio le llega a todos los demás, y una conexión
+ * entre dos nodos que siguen buscando es una partida (ambos pasan a ocupados y
+ * lo anuncian). Cuenta los datagramas y los intentos de conexión durante 5
+ * minutos; cada fila reporta uno de los contadores: datagramas enviados,
+ * datagramas recibidos o intentos de conexión.
+ */
+void Benchmarks::discovery()
+{
+    static const qint64 Duration = 5 * 60 * 1000;
+    QFETCH(int, nodes);
+    QFETCH(int, counter);
+
+    QList<DiscoverySchedule> schedules;
+    QVector<quint32> sequence(nodes, 0);
+    QVector<qint64> nextAnnouncement(nodes, 0);
+    QMultiMap<qint64, int> timers;
+    quint32 random = 7;
+    for (int i = 0; i < nodes; ++i) {
+        random = random * 1103515245 + 12345;
+        schedules << DiscoverySchedule((random >> 8) ^ (random << 16));
+        // Los nodos arrancan durante el primer segundo
+        nextAnnouncement[i] = (random >> 16) % DiscoverySchedule::MinInterval;
+        timers.insert(nextAnnouncement[i], i);
+    }
+
+    quint64 sent = 0;
+    quint64 received = 0;
+    quint64 attempts = 0;
+    int games = 0;
+    QList<int> announcing;
+    while (!timers.isEmpty()) {
+        const qint64 now = timers.constBegin().key();
+        const int node = timers.constBegin().value();
+        timers.erase(timers.begin());
+        if (now > Duration)
+            break;
+        if (nextAnnouncement[node] != now)
+            continue;
+
+        // Fin del intervalo (el primero equivale a startBroadcasting())
+        DiscoverySchedule &schedule = schedules[node];
+        if (sequence[node] == 0 || schedule.endInterval())
+            announcing << node;
+        schedule.expire(now);
+        nextAnnouncement[node] = now + schedule.interval();
+        timers.insert(nextAnnouncement[node], node);
+
+        while (!announcing.isEmpty()) {
+            const int from = announcing.takeFirst();
+            const quint32 seq = ++sequence[from];
+            const bool seeking = schedules.at(from).isSeeking();
+            ++sent;
+            for (int to = 0; to < nodes; ++to) {
+                if (to == from)
+                    continue;
+                ++received;
+                DiscoverySchedule &listener = schedules[to];
+                const int reaction = listener.heard(schedules.at(from).id(), seq, seeking, now);
+                if (reaction & DiscoverySchedule::AnnounceNow) {
+                    listener.reset();
+                    announcing << to;
+                    nextAnnouncement[to] = now + listener.interval();
+                    timers.insert(nextAnnouncement[to], to);
+                }
+                if (!(reaction & DiscoverySchedule::Dial) || !listener.isSeeking())
+                    continue;
+
+                ++attempts;
+                if (!schedules.at(from).isSeeking())
+                    continue;
+                // Empieza la partida: ambos cambian de estado y lo anuncian ya
+                ++games;
+                const int pair[2] = { from, to };
+                for (int k = 0; k < 2; ++k) {
+                    schedules[pair[k]].setSeeking(false);
+                    schedules[pair[k]].reset();
+                    announcing << pair[k];
+                    nextAnnouncement[pair[k]] = now + schedules.at(pair[k]).interval();
+                    timers.insert(nextAnnouncement[pair[k]], pair[k]);
+                }
+            }
+        }
+    }
+
+    QCOMPARE(games, nodes / 2);
+    const quint64 counters[] = { sent, received, attempts };
+    REPORT_RESULT(qreal(counters[counter]), QTest::Events);
+}
+
+/*
+ * Temporizador de una conexión ociosa en la rueda: al vencer se vuelve a
+ * programar, como el ping de Connection.
+ */
+class IdleTimer : public TimerWheel::Entry
+{
+public:
+    IdleTimer(int period, int *counter) : interval(period), fired(counter) {}
+
+protected:
+    void timeout()
+    {
+        ++*fired;
+        TimerWheel::instance()->schedule(this, interval);
+    }
+
+private:
+    int interval;
+    int *fired;
+};
+
+/*
+ * Tiempo de CPU del proceso (usuario y sistema) en µs, o -1 si no se sabe.
+ */
+static qint64 cpuTime()
+{
+#ifdef Q_OS_UNIX
+    struct rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) != 0)
+        return -1;
+    return (qint64(usage.ru_utime.tv_sec) + usage.ru_stime.tv_sec) * 1000000
+           + usage.ru_utime.tv_usec + usage.ru_stime.tv_usec;
+#else
+    return -1;
+#endif
+}
+
+static void addTimerRows()
+{
+    QTest::addColumn<int>("connections");
+    QTest::addColumn<bool>("wheel");
+    const int counts[] = { 1000, 10000, 50000 };
+    for (int i = 0; i < 3; ++i) {
+        const QByteArray count = QByteArray::number(counts[i]);
+        QTest::newRow((count + "/rueda").constData()) << counts[i] << true;
+        QTest::newRow((count + "/QTimer").constData()) << counts[i] << false;
+    }
+}
+
+void Benchmarks::timersIdle_data()
+{
+    addTimerRows();
+}
+
+/*
+ * Costo de tener connections conexiones ociosas: un temporizador periódico por
+ * conexión en la rueda de temporizadores, o un QTimer por conexión como antes
+ * de TimerWheel. El intervalo es de 1 s (más seguido que los pings reales) y
+ * sus vencimientos se reparten en el segundo. Se mide el tiempo de CPU del
+ * proceso durante 3 s sin otra actividad; el resultado son µs de CPU (usuario
+ * y sistema) por segundo de reloj, reportados como CPUTicks.
+ */
+void Benchmarks::timersIdle()
+{
+    static const int Interval = 1000;
+    static const int Window = 3000;
+    QFETCH(int, connections);
+    QFETCH(bool, wheel);
+
+    firedCount = 0;
+    QList<IdleTimer *> entries;
+    QList<QTimer *> timers;
+    for (int i = 0; i < connections; ++i) {
+        if (wheel) {
+            IdleTimer *entry = new IdleTimer(Interval, &firedCount);
+            TimerWheel::instance()->schedule(entry, qint64(i) * Interval / connections);
+            entries << entry;
+        } else {
+            QTimer *timer = new QTimer;
+            timer->setInterval(Interval);
+            connect(timer, SIGNAL(timeout()), this, SLOT(timerFired()));
+            timer->start();
+            timers << timer;
+        }
+    }
+
+    const qint64 before = cpuTime();
+    if (before < 0) {
+        qDeleteAll(entries);
+        qDeleteAll(timers);
+        SKIP_BENCHMARK("El sistema no reporta el tiempo de CPU");
+    }
+    QTest::qWait(Window);
+    const double perSecond = double(cpuTime() - before) * 1000 / Window;
+    QVERIFY(firedCount > 0);
+    REPORT_RESULT(perSecond, QTest::CPUTicks);
+
+    qDeleteAll(entries);
+    qDeleteAll(timers);
+}
+
+void Benchmarks::timersRearm_data()
+{
+    addTimerRows();
+}
+
+/*
+ * Reprogramar el plazo de todas las conexiones, lo que pasaba en cada lectura
+ * con un temporizador por conexión (killTimer/startTimer) y ahora es mover el
+ * elemento de casilla en la rueda.
+ */
+void Benchmarks::timersRearm()
+{
+    static const int Deadline = 30 * 1000;
+    QFETCH(int, connections);
+    QFETCH(bool, wheel);
+
+    firedCount = 0;
+    QList<IdleTimer *> entries;
+    QList<QTimer *> timers;
+    for (int i = 0; i < connections; ++i) {
+        if (wheel) {
+            entries << new IdleTimer(Deadline, &firedCount);
+        } else {
+            QTimer *timer = new QTimer;
+            timer->setSingleShot(true);
+            timers << timer;
+        }
+    }
+
+    TimerWheel *timerWheel = TimerWheel::instance();
+    QBENCHMARK {
+        foreach (IdleTimer *entry, entries)
+            timerWheel->schedule(entry, Deadline);
+        foreach (QTimer *timer, timers)
+            timer->start(Deadline);
+    }
+
+    qDeleteAll(entries);
+    qDeleteAll(timers);
+}
+
+/*
+ * Directorio nuevo para una bitácora de prueba; removeJournal() lo borra.
+ */
+static QString journalDirectory(const char *name)
+{
+    return QDir(QDir::tempPath()).absoluteFilePath(
+                QString("gato-bench-%1-%2").arg(name).arg(QCoreApplication::applicationPid()));
+}
+
+static void removeJournal(const QString &directory)
+{
+    foreach (const QString &fileName, GameJournal::segmentFiles(directory))
+        QFile::remove(fileName);
+    QDir().rmdir(directory);
+}
+
+/*
+ * Lo que agrega anotar una jugada al hilo del juego; la escritura va en otro hilo.
+ */
+void Benchmarks::journalAppend()
+{
+    const QString directory = journalDirectory("append");
+    {
+        GameJournal journal(directory);
+        QVERIFY(journal.isOpen());
+        const quint32 game = journal.startGame(3, 3, 3);
+        int move = 0;
+        QBENCHMARK {
+            ++move;
+            journal.recordMove(game, move, move % 9, GameState::Mark(move % 2));
+        }
+        journal.flush();
+        QCOMPARE(journal.droppedRecords(), quint64(0));
+    }
+    removeJournal(directory);
+}
+
+/*
+ * Verificar una bitácora de 100 mil partidas de 3x3 al azar, leyendo los
+ * segmentos mapeados en memoria.
+ */
+void Benchmarks::journalVerify()
+{
+    static const int Games = 100000;
+    const QString directory = journalDirectory("verify");
+    {
+        GameJournal journal(directory);
+        QVERIFY(journal.isOpen());
+        quint32 random = 1;
+        for (int i = 0; i < Games; ++i) {
+            GameEngine engine;
+            const quint32 game = journal.startGame(3, 3, 3);
+            int moves = 0;
+            while (engine.result() == GameEngine::InProgress) {
+                random = random * 1103515245 + 12345;
+                int pos = (random >> 16) % 9;
+                while (!engine.canPlayAt(pos))
+                    pos = (pos + 1) % 9;
+                const GameState::Mark mark = moves % 2 ? GameState::Circle : GameState::Cross;
+                engine.play(pos, mark);
+                journal.recordMove(game, ++moves, pos, mark);
+            }
+            journal.finishGame(game, moves, engine.result());
+        }
+        journal.flush();
+    }
+
+    JournalReader reader;
+    QVERIFY(reader.open(directory));
+    JournalReader::Stats stats;
+    QBENCHMARK {
+        stats = reader.verify();
+    }
+    QCOMPARE(stats.errors, quint64(0));
+    QCOMPARE(stats.finishedGames, quint64(Games));
+    reader.close();
+    removeJournal(directory);
+}
+
+void Benchmarks::connectionReady()
+{
+    ++readyCount;
+}
+
+void Benchmarks::timerFired()
+{
+    ++firedCount;
+}
+
+void Benchmarks::connectionAccepted(Connection *connection)
+{
+    accepted << connection;
+    connect(connection, SIGNAL(readyForUse()), this, SLOT(connectionReady()));
+}
+
+#if QT_VERSION >= 0x050000
+QTEST_GUILESS_MAIN(Benchmarks)
+#else
+QTEST_MAIN(Benchmarks)
+#endif
+
+#include "benchmarks.moc"
@@ -0,0 +1,260 @@
+#include "boardwidget.h"
+
+#include <QMouseEvent>
+#include <QPainter>
+#include <QPaintEvent>
+#include <QResizeEvent>
+
+BoardWidget::BoardWidget(QWidget *parent)
+    : QWidget(parent)
+{
+    rowCount = 0;
+    columnCount = 0;
+    cellSize = 1;
+    pressedCell = -1;
+    dirtyCells = 0;
+    setAttribute(Qt::WA_OpaquePaintEvent);
+    setSizePolicy(QSizePolicy::Expanding, QSizePolicy::Expanding);
+    setBoardSize(3, 3);
+}
+
+/*!
+ * Cambia las dimensiones del tablero, dejándolo vacío.
+ */
+void BoardWidget::setBoardSize(int rows, int columns)
+{
+    if (rows <= 0 || columns <= 0)
+        return;
+
+    rowCount = rows;
+    columnCount = columns;
+    marks.fill(GameState::Empty, rows * columns);
+    highlighted.fill(false, rows * columns);
+    highlightedCells.clear();
+    pressedCell = -1;
+    layoutCells();
+    update();
+}
+
+int BoardWidget::rows() const
+{
+    return rowCount;
+}
+
+int BoardWidget::columns() const
+{
+    return columnCount;
+}
+
+GameState::Mark BoardWidget::cell(int pos) const
+{
+    return marks.at(pos);
+}
+
+void BoardWidget::setCell(int pos, GameState::Mark mark)
+{
+    if (pos < 0 || pos >= marks.size() || marks.at(pos) == mark)
+        return;
+    marks[pos] = mark;
+    markDirty(pos);
+}
+
+/*!
+ * Muestra el tablero del estado; solo se vuelven a dibujar las casillas que
+ * cambiaron, así recibir el estado completo en cada jugada cuesta lo mismo que
+ * marcar una casilla.
+ */
+void BoardWidget::setState(const GameState &state)
+{
+    if (state.rows != rowCount || state.columns != columnCount)
+        setBoardSize(state.rows, state.columns);
+    if (state.cells.size() != marks.size())
+        return;
+
+    const GameState::Mark *next = state.cells.constData();
+    for (int i = 0; i < marks.size(); ++i) {
+        if (marks.at(i) != next[i]) {
+            marks[i] = next[i];
+            markDirty(i);
+        }
+    }
+}
+
+/*!
+ * Resalta las casillas (ej. la línea ganadora) y quita el resaltado anterior.
+ */
+void BoardWidget::setHighlighted(const QList<int> &cells)
+{
+    foreach (int pos, highlightedCells) {
+        highlighted.clearBit(pos);
+        markDirty(pos);
+    }
+    highlightedCells.clear();
+    foreach (int pos, cells) {
+        if (pos < 0 || pos >= marks.size())
+            continue;
+        highlighted.setBit(pos);
+        highlightedCells << pos;
+        markDirty(pos);
+    }
+}
+
+void BoardWidget::clear()
+{
+    marks.fill(GameState::Empty);
+    highlighted.fill(false);
+    highlightedCells.clear();
+    update();
+}
+
+/*!
+ * Casilla bajo el punto, o -1 si está fuera del tablero. No recorre las
+ * casillas: todas son cuadros del mismo tamaño.
+ */
+int BoardWidget::cellAt(const QPoint &point) const
+{
+    const int x = point.x() - origin.x();
+    const int y = point.y() - origin.y();
+    if (x < 0 || y < 0)
+        return -1;
+    const int column = x / cellSize;
+    const int row = y / cellSize;
+    if (column >= columnCount || row >= rowCount)
+        return -1;
+    return row * columnCount + column;
+}
+
+QRect BoardWidget::cellRect(int pos) const
+{
+    return QRect(origin.x() + pos % columnCount * cellSize,
+                 origin.y() + pos / columnCount * cellSize, cellSize, cellSize);
+}
+
+/*!
+ * El tamaño de los 9 botones de antes.
+ */
+QSize BoardWidget::sizeHint() const
+{
+    return QSize(450, 450);
+}
+
+QSize BoardWidget::minimumSizeHint() const
+{
+    return QSize(columnCount, rowCount);
+}
+
+/*!
+ * Casillas cuadradas lo más grandes posible, con el tablero centrado.
+ */
+void BoardWidget::layoutCells()
+{
+    cellSize = qMax(1, qMin(width() / columnCount, height() / rowCount));
+    origin = QPoint((width() - cellSize * columnCount) / 2,
+                    (height() - cellSize * rowCount) / 2);
+}
+
+/*!
+ * Pide redibujar solo la casilla. Qt junta todas las que cambien antes de la
+ * siguiente pintada en una sola región; con demasiadas es más barato
+ * redibujar todo el widget.
+ */
+void BoardWidget::markDirty(int pos)
+{
+    if (dirtyCells > MaxDirtyCells)
+        return;
+    if (++dirtyCells > MaxDirtyCells)
+        update();
+    else
+        update(cellRect(pos));
+}
+
+void BoardWidget::paintEvent(QPaintEvent *event)
+{
+    dirtyCells = 0;
+
+    QPainter painter(this);
+    const QRect board(origin, QSize(cellSize * columnCount, cellSize * rowCount));
+    const QRegion margin = QRegion(event->rect()).subtracted(board);
+    /* QRegion::rects() es obsoleta desde Qt 5.8; desde ahí se recorre la región */
+#if QT_VERSION >= 0x050800
+    for (const QRect &rect : margin)
+#else
+    foreach (const QRect &rect, margin.rects())
+#endif
+        painter.fillRect(rect, palette().color(QPalette::Window));
+
+    if (cellSize >= MinTextSize) {
+        QFont font = painter.font();
+        font.setPixelSize(cellSize * 3 / 5);
+        font.setBold(true);
+        painter.setFont(font);
+    }
+    painter.setPen(palette().color(isEnabled() ? QPalette::Active : QPalette::Disabled,
+                                   QPalette::ButtonText));
+#if QT_VERSION >= 0x050800
+    for (const QRect &rect : event->region())
+#else
+    foreach (const QRect &rect, event->region().rects())
+#endif
+        paintCells(&painter, rect & board);
+}
+
+/*!
+ * Dibuja solo las casillas que tocan el área: X en rojo, O en azul y la línea
+ * ganadora en verde, como los botones de antes.
+ */
+void BoardWidget::paintCells(QPainter *painter, const QRect &area)
+{
+    if (area.isEmpty())
+        return;
+
+    const int firstColumn = (area.left() - origin.x()) / cellSize;
+    const int lastColumn = qMin(columnCount - 1, (area.right() - origin.x()) / cellSize);
+    const int firstRow = (area.top() - origin.y()) / cellSize;
+    const int lastRow = qMin(rowCount - 1, (area.bottom() - origin.y()) / cellSize);
+    const int gap = cellSize >= 4 ? 1 : 0;
+
+    for (int row = firstRow; row <= lastRow; ++row) {
+        for (int column = firstColumn; column <= lastColumn; ++column) {
+            const int pos = row * columnCount + column;
+            const QRect rect = cellRect(pos);
+            const GameState::Mark mark = marks.at(pos);
+
+            QColor color = Qt::white;
+            if (highlighted.testBit(pos))
+                color = Qt::green;
+            else if (mark == GameState::Cross)
+                color = Qt::red;
+            else if (mark == GameState::Circle)
+                color = Qt::blue;
+            painter->fillRect(rect, Qt::darkGray);
+            painter->fillRect(rect.adjusted(gap, gap, -gap, -gap), color);
+
+            if (mark != GameState::Empty && cellSize >= MinTextSize)
+                painter->drawText(rect, Qt::AlignCenter,
+                                  mark == GameState::Cross ? QString("X") : QString("O"));
+        }
+    }
+}
+
+void BoardWidget::resizeEvent(QResizeEvent *event)
+{
+    QWidget::resizeEvent(event);
+    layoutCells();
+}
+
+void BoardWidget::mousePressEvent(QMouseEvent *event)
+{
+    pressedCell = event->button() == Qt::LeftButton ? cellAt(event->pos()) : -1;
+}
+
+/*!
+ * Como un botón: cuenta el clic si se suelta sobre la misma casilla en la que se presionó.
+ */
+void BoardWidget::mouseReleaseEvent(QMouseEvent *event)
+{
+    const int pos = pressedCell;
+    pressedCell = -1;
+    if (event->button() == Qt::LeftButton && pos != -1 && cellAt(event->pos()) == pos)
+        emit cellClicked(pos);
+}
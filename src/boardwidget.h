@@ -0,0 +1,73 @@
+#ifndef BOARDWIDGET_H
+#define BOARDWIDGET_H
+
+#include <QBitArray>
+#include <QList>
+#include <QPoint>
+#include <QRect>
+#include <QVector>
+#include <QWidget>
+
+#include "gamestate.h"
+
+class QPainter;
+
+/*
+ * Tablero de cualquier tamaño (m,n,k) dibujado en un solo widget, en lugar de
+ * un botón por casilla. Un clic se convierte en casilla con una división, y al
+ * cambiar una casilla solo se vuelve a dibujar su rectángulo: una jugada en un
+ * tablero de 100x100 (el lado llega hasta GameState::MaxSide) dibuja una
+ * casilla, no diez mil.
+ */
+class BoardWidget : public QWidget
+{
+    Q_OBJECT
+
+public:
+    static const int MinTextSize = 12;   // en casillas más chicas solo se ve el color
+    static const int MaxDirtyCells = 256; // con más cambios se redibuja todo de una vez
+
+    explicit BoardWidget(QWidget *parent = 0);
+
+    void setBoardSize(int rows, int columns);
+    int rows() const;
+    int columns() const;
+
+    GameState::Mark cell(int pos) const;
+    void setCell(int pos, GameState::Mark mark);
+    void setState(const GameState &state);
+    void setHighlighted(const QList<int> &cells);
+    void clear();
+
+    int cellAt(const QPoint &point) const;
+    QRect cellRect(int pos) const;
+
+    QSize sizeHint() const;
+    QSize minimumSizeHint() const;
+
+signals:
+    void cellClicked(int pos);
+
+protected:
+    void paintEvent(QPaintEvent *event);
+    void resizeEvent(QResizeEvent *event);
+    void mousePressEvent(QMouseEvent *event);
+    void mouseReleaseEvent(QMouseEvent *event);
+
+private:
+    void layoutCells();
+    void markDirty(int pos);
+    void paintCells(QPainter *painter, const QRect &area);
+
+    int rowCount;
+    int columnCount;
+    QVector<GameState::Mark> marks;
+    QBitArray highlighted;
+    QList<int> highlightedCells;
+    int cellSize;
+    QPoint origin;
+    int pressedCell;
+    int dirtyCells;
+};
+
+#endif
@@ -1,7 +1,48 @@
 #include "client.h"
+#include "metrics.h"
+
+#include <QUuid>
+
+/*
+ * Los estados de base con los que empieza cualquier conexión, ver Connection.
+ */
+static GameState initialState()
+{
+    GameState state;
+    state.status = GameState::NobodyWon;
+    return state;
+}
+
+static QByteArray newSessionToken()
+{
+    return QUuid::createUuid().toString().toLatin1().mid(1, 36);
+}
+
+/*
+ * Los dos puertos de la conexión, el menor primero. Ambos extremos ven el mismo
+ * par, así que sirve para que los dos elijan la misma de dos conexiones.
+ */
+static QPair<quint16, quint16> portPair(const Connection *connection)
+{
+    const quint16 local = connection->localPort();
+    const quint16 remote = connection->peerPort();
+    return local < remote ? qMakePair(local, remote) : qMakePair(remote, local);
+}
 
 Client::Client()
 {
+    opponent = 0;
+    currentSession = 0;
+    opponentPort = 0;
+    dialedOpponent = false;
+    suspended = false;
+    resumeAttempt = 0;
+    sentCount = 0;
+    receivedCount = 0;
+    lastReceived = initialState();
+    graceTimer.setSingleShot(true);
+    connect(&graceTimer, SIGNAL(timeout()), this, SLOT(resumeExpired()));
+    connect(&retryTimer, SIGNAL(timeout()), this, SLOT(retryResume()));
     peerManager = new PeerManager(this);
     // El puerto de la clase Server se detecta automáticamente mediante
     // la función predeterminada de Qt serverPort().
@@ -15,16 +56,44 @@ Client::Client()
 }
 
 /*!
-  Manda el mensaje a los nodos conectados, que están almacenados en peers
+  Al cerrar el programa le avisa al oponente que la partida ya no se podrá
+  reanudar, así no tiene que esperar a que se acabe el plazo.
+*/
+Client::~Client()
+{
+    if (opponent) {
+        opponent->sendSessionToken(QByteArray());
+        opponent->flushOutput();
+    }
+}
+
+/*!
+  Manda el mensaje solo al oponente de la partida actual
 */
 void Client::sendMessage(const QString &message)
 {
-    if (message.isEmpty())
+    if (message.isEmpty() || !opponent)
         return;
 
-    QList<Connection *> connections = peers.values();
-    foreach (Connection *connection, connections)
-        connection->sendMessage(message);
+    opponent->sendMessage(message);
+}
+
+/*!
+  Manda el estado del juego al oponente, con el protocolo que acordó con él.
+  Los últimos estados se guardan para ponerlo al día si se reanuda la partida;
+  mientras la conexión está caída solo se guardan.
+*/
+void Client::sendGameState(const GameState &gameState)
+{
+    if (!opponent && !suspended)
+        return;
+
+    sentStates.append(gameState);
+    if (sentStates.size() > MaxResumeHistory)
+        sentStates.removeFirst();
+    ++sentCount;
+    if (opponent)
+        opponent->sendGameState(gameState);
 }
 
 
@@ -38,23 +107,30 @@ QString Client::nickName() const
 }
 
 /*!
-  Método que comprueba si la ip de quien envía un paquete tiene conexión con nosotros.
+  Indica si ya hay una partida en curso, aunque se esté esperando a que el
+  oponente se reconecte; mientras tanto no se buscan más oponentes.
 */
-bool Client::hasConnection(const QHostAddress &senderIp, int senderPort) const
+bool Client::isPlaying() const
 {
-    if (senderPort == -1)
-        return peers.contains(senderIp);
-
-    if (!peers.contains(senderIp))
-        return false;
+    return opponent != 0 || suspended;
+}
 
-    QList<Connection *> connections = peers.values(senderIp);
-    foreach (Connection *connection, connections) {
-        if (connection->peerPort() == senderPort)
-            return true;
-    }
+/*!
+  Identificador de la partida actual, o 0 si no hay partida.
+*/
+quint32 Client::sessionId() const
+{
+    return currentSession;
+}
 
-    return false;
+/*!
+  Método que comprueba si el nodo que anuncia su servidor en senderIp:senderPort
+  tiene conexión con nosotros. Con el puerto se distingue entre varios nodos
+  detrás de la misma dirección.
+*/
+bool Client::hasConnection(const QHostAddress &senderIp, quint16 senderPort) const
+{
+    return peers.contains(senderIp, senderPort);
 }
 
 /*!
@@ -64,6 +140,10 @@ bool Client::hasConnection(const QHostAddress &senderIp, int senderPort) const
 void Client::newConnection(Connection *connection)
 {
     connection->setGreetingMessage(peerManager->userName());
+    connection->setServerPort(server.serverPort());
+    // Contestar el saludo equivale a aceptar la partida, así que las conexiones
+    // entrantes esperan en la cola hasta que estemos libres.
+    connection->setGreetingDeferred(true);
 
     connect(connection, SIGNAL(error(QAbstractSocket::SocketError)), this, SLOT(connectionError(QAbstractSocket::SocketError)));
     connect(connection, SIGNAL(disconnected()), this, SLOT(disconnected()));
@@ -71,24 +151,271 @@ void Client::newConnection(Connection *connection)
 }
 
 /*!
-  Actualiza variables, como las señales una vez que la conexión está lista para ser usada.
+  La conexión ya recibió el saludo del otro nodo. Si nosotros ya mandamos el
+  nuestro (porque nosotros iniciamos la conexión) ambos aceptaron y empieza la
+  partida, a menos que ya estemos jugando con alguien más. Si no, espera en la
+  cola a que estemos libres. Un saludo con el token de la partida actual la
+  reanuda en lugar de empezar otra.
 */
 void Client::readyForUse()
 {
     Connection *connection = qobject_cast<Connection *>(sender());
-    if (!connection || hasConnection(connection->peerAddress(),
-                                     connection->peerPort()))
+    if (!connection)
         return;
 
-    connect(connection, SIGNAL(newMessage(QString)),
-            this, SIGNAL(newMessage(QString)));
+    // Respuesta a nuestro intento de reanudar: si el oponente ya no tiene la
+    // partida, la conexión sirve para empezar una nueva con él
+    if (connection == resumeAttempt) {
+        resumeAttempt = 0;
+        if (!admit(connection))
+            return;
+        if (!localToken.isEmpty() && connection->peerResumeToken() == localToken) {
+            resumeSession(connection);
+        } else {
+            endSession();
+            startSession(connection, true);
+        }
+        return;
+    }
+
+    // El oponente vuelve con el token que le dimos, aunque aún no hayamos
+    // notado que la conexión anterior se cayó
+    const QByteArray token = connection->peerResumeToken();
+    if (!token.isEmpty() && token == localToken && !opponentToken.isEmpty()
+            && (opponent || suspended) && !connection->isGreetingSent()) {
+        if (Connection *previous = opponent) {
+            opponent = 0;
+            removeConnection(previous);
+        }
+        if (!admit(connection))
+            return;
+        connection->setResumeRequest(opponentToken, receivedCount);
+        connection->sendGreetingMessage();
+        resumeSession(connection);
+        return;
+    }
+
+    if (!admit(connection))
+        return;
+
+    if (connection->isGreetingSent()) {
+        if (isPlaying())
+            connection->abort();
+        else
+            startSession(connection, true);
+        return;
+    }
+
+    matchmaker.enqueue(connection);
+    findOpponent();
+}
+
+/*!
+  Registra la conexión recién saludada. Si ya había otra con el mismo nodo es
+  porque ambos nos llamamos a la vez; los dos lados se quedan con la misma, la
+  de menor par de puertos, y la otra se cierra. Si la que se cierra ya tenía la
+  partida, la partida sigue en la que queda con los estados que ya mandamos, que
+  el otro lado nunca leyó. Regresa true si hay que seguir con la conexión.
+*/
+bool Client::admit(Connection *connection)
+{
+    if (peers.insert(connection))
+        return true;
+
+    Connection *existing = peers.find(connection->peerAddress(), connection->peerServerPort());
+    if (!existing || existing == connection)
+        return false;
+    if (!(portPair(connection) < portPair(existing))) {
+        dropConnection(connection);
+        return false;
+    }
+    if (existing != opponent) {
+        dropConnection(existing);
+        return peers.insert(connection);
+    }
+
+    const QList<GameState> unseen = sentStates;
+    opponent = 0;
+    dropConnection(existing);
+    peers.insert(connection);
+    const bool dialed = connection->isGreetingSent();
+    if (!dialed)
+        connection->sendGreetingMessage();
+    startSession(connection, dialed);
+    foreach (const GameState &state, unseen)
+        sendGameState(state);
+    return false;
+}
+
+/*!
+  Si estamos libres, acepta al primer nodo de la cola contestándole el saludo.
+*/
+void Client::findOpponent()
+{
+    if (isPlaying())
+        return;
+
+    if (Connection *connection = matchmaker.takeNext()) {
+        connection->sendGreetingMessage();
+        startSession(connection, false);
+    }
+}
+
+/*!
+  Empieza la partida con el nodo: solo sus mensajes llegan a la interfaz. Se le
+  da un token con el que puede reanudarla si se cae la conexión; dialed indica
+  si nosotros iniciamos la conexión, y por lo tanto somos quienes vuelven a llamar.
+*/
+void Client::startSession(Connection *connection, bool dialed)
+{
+    opponent = connection;
+    currentSession = matchmaker.startSession(connection);
+    peers.setSession(connection, currentSession);
+    peerManager->setSeeking(false);
+
+    // El socket olvida la dirección al desconectarse, se guarda desde ahora
+    opponentAddress = connection->peerAddress();
+    opponentPort = connection->peerServerPort();
+    dialedOpponent = dialed;
+    sentStates.clear();
+    sentCount = 0;
+    receivedCount = 0;
+    lastReceived = initialState();
+    opponentToken.clear();
+    localToken = newSessionToken();
+    if (!connection->sendSessionToken(localToken))
+        localToken.clear();
+    watchOpponent(connection);
 
-    peers.insert(connection->peerAddress(), connection);
     QString nick = connection->name();
     if (!nick.isEmpty())
         emit newOponent(nick);
 }
 
+void Client::watchOpponent(Connection *connection)
+{
+    connect(connection, SIGNAL(newMessage(QString)),
+            this, SIGNAL(newMessage(QString)));
+    connect(connection, SIGNAL(newGameState(GameState)),
+            this, SLOT(receiveGameState(GameState)));
+    connect(connection, SIGNAL(sessionToken(QByteArray)),
+            this, SLOT(receiveSessionToken(QByteArray)));
+}
+
+/*!
+  Cuenta los estados recibidos del oponente; al reanudar le decimos cuántos
+  llegaron para que nos mande solo los que faltan.
+*/
+void Client::receiveGameState(const GameState &gameState)
+{
+    ++receivedCount;
+    lastReceived = gameState;
+    emit newGameState(gameState);
+}
+
+void Client::receiveSessionToken(const QByteArray &token)
+{
+    if (sender() == opponent)
+        opponentToken = token;
+}
+
+/*!
+  La conexión con el oponente se cayó pero la partida se puede reanudar: se
+  conserva durante ResumeGraceWindow ms. Quien inició la conexión vuelve a
+  llamar a la misma dirección; el otro solo espera.
+*/
+void Client::suspendSession()
+{
+    suspended = true;
+    Metrics::add(Metrics::SessionsSuspended);
+    graceTimer.start(ResumeGraceWindow);
+    if (dialedOpponent) {
+        retryTimer.start(ResumeRetryInterval);
+        retryResume();
+    }
+    emit oponentSuspended();
+}
+
+/*!
+  Intenta otra vez la conexión con el oponente. Un intento que ni siquiera
+  conectó se descarta, el enlace pudo volver mientras esperaba.
+*/
+void Client::retryResume()
+{
+    if (!suspended)
+        return;
+    if (resumeAttempt) {
+        if (resumeAttempt->QAbstractSocket::state() == QAbstractSocket::ConnectedState)
+            return;
+        Connection *stale = resumeAttempt;
+        resumeAttempt = 0;
+        removeConnection(stale);
+    }
+
+    Connection *connection = new Connection(this);
+    resumeAttempt = connection;
+    newConnection(connection);
+    connection->setResumeRequest(opponentToken, receivedCount);
+    connection->connectToHost(opponentAddress, opponentPort);
+}
+
+/*!
+  Sigue la partida en la conexión nueva. Con lo que el oponente dice haber
+  recibido se le mandan solo los estados que le faltan, como jugadas sobre el
+  último que sí tiene; todo en la misma vuelta que el saludo.
+*/
+void Client::resumeSession(Connection *connection)
+{
+    suspended = false;
+    graceTimer.stop();
+    retryTimer.stop();
+    opponent = connection;
+    currentSession = matchmaker.startSession(connection);
+    peers.setSession(connection, currentSession);
+    watchOpponent(connection);
+
+    const quint32 seen = qMin(connection->peerResumeSeen(), sentCount);
+    const int first = sentStates.size() - int(sentCount - seen);
+    GameState base = initialState();
+    if (seen > 0 && first > 0)
+        base = sentStates.at(first - 1);
+    connection->setGameStateBases(base, lastReceived);
+    for (int i = qMax(first, 0); i < sentStates.size(); ++i)
+        connection->sendGameState(sentStates.at(i));
+
+    Metrics::add(Metrics::SessionsResumed);
+    emit oponentResumed();
+}
+
+void Client::resumeExpired()
+{
+    if (!suspended)
+        return;
+    if (Connection *attempt = resumeAttempt) {
+        resumeAttempt = 0;
+        removeConnection(attempt);
+    }
+    endSession();
+    findOpponent();
+    if (!opponent)
+        peerManager->setSeeking(true);
+}
+
+/*!
+  La partida terminó sin poder reanudarse.
+*/
+void Client::endSession()
+{
+    suspended = false;
+    graceTimer.stop();
+    retryTimer.stop();
+    currentSession = 0;
+    localToken.clear();
+    opponentToken.clear();
+    sentStates.clear();
+    emit oponentLeft();
+}
+
 /*!
   Método que emite la señal de desconectado
 */
@@ -104,11 +431,41 @@ void Client::connectionError(QAbstractSocket::SocketError /* socketError */)
         removeConnection(connection);
 }
 
+/*!
+  Cierra una conexión que sobra sin avisar a nadie.
+*/
+void Client::dropConnection(Connection *connection)
+{
+    peers.remove(connection);
+    matchmaker.remove(connection);
+    connection->disconnect(this);
+    connection->abort();
+    connection->deleteLater();
+}
+
+/*!
+  Olvida la conexión. Si era nuestro oponente y la partida se puede reanudar se
+  espera a que vuelva; si no, se avisa a la interfaz y se pasa al siguiente nodo
+  que estaba esperando.
+*/
 void Client::removeConnection(Connection *connection)
 {
-    if (peers.contains(connection->peerAddress())) {
-        peers.remove(connection->peerAddress());
-        emit oponentLeft();
-    }
+    if (connection == resumeAttempt)
+        resumeAttempt = 0;
+    peers.remove(connection);
+    matchmaker.remove(connection);
+    connection->disconnect(this);
     connection->deleteLater();
+
+    if (connection == opponent) {
+        opponent = 0;
+        if (!opponentToken.isEmpty()) {
+            suspendSession();
+            return;
+        }
+        endSession();
+        findOpponent();
+        if (!opponent)
+            peerManager->setSeeking(true);
+    }
 }
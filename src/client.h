@@ -4,8 +4,12 @@
 #include <QAbstractSocket>
 #include <QHash>
 #include <QHostAddress>
+#include <QList>
+#include <QTimer>
 #include <QtNetwork>
 #include "connection.h"
+#include "connectionregistry.h"
+#include "matchmaker.h"
 #include "peermanager.h"
 #include "server.h"
 
@@ -17,29 +21,70 @@ class Client : public QObject
     Q_OBJECT
 
 public:
+    static const int ResumeGraceWindow = 90 * 1000;   // más que el plazo del Pong
+    static const int ResumeRetryInterval = 1000;
+    static const int MaxResumeHistory = 32;
+
     Client();
+    ~Client();
 
     void sendMessage(const QString &message);
+    void sendGameState(const GameState &gameState);
     QString nickName() const;
-    bool hasConnection(const QHostAddress &senderIp, int senderPort = -1) const;
+    bool isPlaying() const;
+    quint32 sessionId() const;
+    bool hasConnection(const QHostAddress &senderIp, quint16 senderPort) const;
 
 signals:
     void newMessage(const QString &message);
+    void newGameState(const GameState &gameState);
     void newOponent(const QString &nick);
     void oponentLeft();
+    void oponentSuspended();
+    void oponentResumed();
 
 private slots:
     void newConnection(Connection *connection);
     void connectionError(QAbstractSocket::SocketError socketError);
     void disconnected();
     void readyForUse();
+    void receiveGameState(const GameState &gameState);
+    void receiveSessionToken(const QByteArray &token);
+    void retryResume();
+    void resumeExpired();
 
 private:
     void removeConnection(Connection *connection);
+    void dropConnection(Connection *connection);
+    bool admit(Connection *connection);
+    void findOpponent();
+    void startSession(Connection *connection, bool dialed);
+    void watchOpponent(Connection *connection);
+    void suspendSession();
+    void resumeSession(Connection *connection);
+    void endSession();
 
     PeerManager *peerManager;
     Server server;
-    QMultiHash<QHostAddress, Connection *> peers;
+    ConnectionRegistry peers;
+    Matchmaker matchmaker;
+    Connection *opponent;
+    quint32 currentSession;
+
+    // Para reanudar la partida si se cae la conexión con el oponente
+    QByteArray localToken;      // el que le dimos al oponente
+    QByteArray opponentToken;   // el que nos dio, vacío si no se puede reanudar
+    QHostAddress opponentAddress;
+    quint16 opponentPort;
+    bool dialedOpponent;        // solo quien inició la conexión vuelve a llamar
+    bool suspended;
+    Connection *resumeAttempt;
+    QTimer graceTimer;
+    QTimer retryTimer;
+    QList<GameState> sentStates;   // los últimos MaxResumeHistory estados mandados
+    quint32 sentCount;
+    quint32 receivedCount;
+    GameState lastReceived;
 };
 
 #endif
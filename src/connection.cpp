@@ -1,35 +1,183 @@
 #include "connection.h"
+#include "metrics.h"
+#include "objectpool.h"
+#include "outgoingframe.h"
+
+#include <QSet>
+
+#include <limits.h>
+
+#ifdef Q_OS_LINUX
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#endif
 
 static const int TransferTimeout = 30 * 1000;
 static const int PongTimeout = 60 * 1000;
-static const int PingInterval = 5 * 1000;
-static const char SeparatorToken = ' ';
+static const int MinPingInterval = 5 * 1000;
+static const int MaxPingInterval = PongTimeout / 3;
+static const int MaxEchoSize = 20;
+static const char ProtocolTag[] = ";proto=";
+static const char ResumeTag[] = ";resume=";
+static const char ListenTag[] = ";listen=";
+static const int MaxInternedNames = 4096;
+
+/*
+ * Reloj monótono en microsegundos para las marcas de tiempo de los pings; es el
+ * mismo para todos los hilos.
+ */
+static qint64 monotonicMicroseconds()
+{
+    struct Clock {
+        Clock() { timer.start(); }
+        QElapsedTimer timer;
+    };
+    static const Clock clock;
+    return clock.timer.nsecsElapsed() / 1000;
+}
+
+/*
+ * Textos iniciales compartidos por todas las conexiones, así crear una no
+ * reserva memoria para ellos.
+ */
+static const QString &undefinedGreeting()
+{
+    static const QString text = QObject::tr("undefined");
+    return text;
+}
+
+static const QString &unknownName()
+{
+    static const QString text = QObject::tr("unknown");
+    return text;
+}
+
+/*
+ * Muchos clientes usan el mismo nombre (el usuario del sistema, el del generador
+ * de carga); las conexiones con el mismo nombre comparten una sola copia. Para
+ * no crecer sin límite con nombres únicos, pasando MaxInternedNames ya no se
+ * agregan nuevos.
+ */
+static QByteArray internName(const QByteArray &name)
+{
+    static QMutex mutex;
+    static QSet<QByteArray> names;
+
+    QMutexLocker locker(&mutex);
+    QSet<QByteArray>::const_iterator it = names.constFind(name);
+    if (it != names.constEnd())
+        return *it;
+    if (names.size() < MaxInternedNames)
+        names.insert(name);
+    return name;
+}
+
+Connection::SocketSettings::SocketSettings()
+{
+    lowDelay = true;
+    keepAliveIdle = 0;
+    keepAliveInterval = 10;
+    keepAliveCount = 3;
+}
+
+/*
+ * Opciones iniciales: GATO_TCP_NODELAY=0 vuelve a activar el algoritmo de Nagle y
+ * GATO_TCP_KEEPALIVE=espera[,intervalo[,sondeos]] (en segundos) activa los
+ * sondeos de TCP en las conexiones ociosas.
+ */
+static Connection::SocketSettings settingsFromEnvironment()
+{
+    Connection::SocketSettings settings;
+    if (qgetenv("GATO_TCP_NODELAY") == "0")
+        settings.lowDelay = false;
+
+    QList<QByteArray> keepAlive = qgetenv("GATO_TCP_KEEPALIVE").split(',');
+    int *fields[] = { &settings.keepAliveIdle, &settings.keepAliveInterval,
+                      &settings.keepAliveCount };
+    for (int i = 0; i < keepAlive.size() && i < 3; ++i) {
+        bool ok;
+        const int value = keepAlive.at(i).trimmed().toInt(&ok);
+        if (ok && value >= 0)
+            *fields[i] = value;
+    }
+    return settings;
+}
+
+static Connection::SocketSettings &currentSettings()
+{
+    static Connection::SocketSettings settings = settingsFromEnvironment();
+    return settings;
+}
 
 Connection::Connection(QObject *parent)
-    : QTcpSocket(parent)
+    : QTcpSocket(parent),
+      smoothedRtt(-1)
 {
-    greetingMessage = tr("undefined");
-    username = tr("unknown");
+    greetingMessage = undefinedGreeting();
+    peerHostPort = 0;
+    localServerPort = 0;
     state = WaitingForGreeting;
-    currentDataType = Undefined;
-    numBytesForCurrentDataType = -1;
-    transferTimerId = 0;
+    wheel = TimerWheel::instance();
+    pingDeadline = 0;
+    pongDeadline = 0;
+    transferDeadline = 0;
+    scheduledDeadline = 0;
+    pingStamp = 0;
+    currentPingInterval = MinPingInterval;
+    peerProtocolVersion = 1;
+    outgoingSequence = 0;
+    incomingSequence = 0;
+    sentState.status = GameState::NobodyWon;
+    receivedState.status = GameState::NobodyWon;
+    sentMoves = 0;
+    receivedMoves = 0;
+    sentHash = 0;
+    receivedHash = 0;
+    awaitingSnapshot = false;
     isGreetingMessageSent = false;
-    pingTimer.setInterval(PingInterval);
+    greetingDeferred = false;
+    flushScheduled = false;
 
     QObject::connect(this, SIGNAL(readyRead()), this, SLOT(processReadyRead()));
-    QObject::connect(this, SIGNAL(disconnected()), &pingTimer, SLOT(stop()));
-    QObject::connect(&pingTimer, SIGNAL(timeout()), this, SLOT(sendPing()));
+    QObject::connect(this, SIGNAL(stateChanged(QAbstractSocket::SocketState)),
+                     this, SLOT(applySocketSettings(QAbstractSocket::SocketState)));
+    QObject::connect(this, SIGNAL(disconnected()), this, SLOT(stopTimers()));
     QObject::connect(this, SIGNAL(connected()),
                      this, SLOT(sendGreetingMessage()));
+    Metrics::add(Metrics::ConnectionsOpened);
+}
+
+Connection::~Connection()
+{
+    Metrics::add(Metrics::ConnectionsClosed);
 }
 
 /*!
- * Regresa el nombre de usuario del nodo conectado (No el nuestro)
+ * Las conexiones se crean y destruyen por miles en el servidor dedicado; su
+ * memoria sale de un pool en lugar de una llamada a malloc por conexión.
+ */
+void *Connection::operator new(size_t size)
+{
+    return ObjectPool<Connection>::allocate(size);
+}
+
+void Connection::operator delete(void *pointer, size_t size)
+{
+    ObjectPool<Connection>::release(pointer, size);
+}
+
+/*!
+ * Regresa el nombre de usuario del nodo conectado (No el nuestro), con su
+ * dirección y puerto: 'usuario@dirección:puerto'. Se arma al pedirlo; la
+ * conexión solo guarda el nombre, compartido con otras del mismo nombre.
 */
 QString Connection::name() const
 {
-    return username;
+    if (peerNick.isNull())
+        return unknownName();
+    return QString::fromUtf8(peerNick) + '@' + peerHost.toString() + ':'
+           + QString::number(peerHostPort);
 }
 
 /*!
@@ -41,247 +189,701 @@ void Connection::setGreetingMessage(const QString &message)
 }
 
 /*!
- * Escribe el mensaje al flujo de datos de la conexión.
+ Si se activa, al recibir el saludo del otro nodo no se le contesta de inmediato;
+ la conexión queda lista pero el saludo propio se manda después con sendGreetingMessage().
+ Así el servidor dedicado hace esperar al cliente hasta que le encuentra un oponente.
+*/
+void Connection::setGreetingDeferred(bool deferred)
+{
+    greetingDeferred = deferred;
+}
+
+/*!
+ Puerto en el que escucha nuestro servidor. Va en el saludo para que el otro nodo
+ nos identifique por (dirección, puerto del servidor) aunque la conexión salga de
+ un puerto efímero; así distingue varios nodos detrás de la misma dirección.
+*/
+void Connection::setServerPort(quint16 port)
+{
+    localServerPort = port;
+}
+
+/*!
+ Puerto del servidor del otro nodo: el que anunció en su saludo o, si no lo
+ anunció, el del socket (que es el de su servidor si nosotros nos conectamos).
+*/
+quint16 Connection::peerServerPort() const
+{
+    return peerHostPort;
+}
+
+/*!
+ Indica si ya mandamos nuestro saludo, es decir, si ya aceptamos jugar con este nodo.
+*/
+bool Connection::isGreetingSent() const
+{
+    return isGreetingMessageSent;
+}
+
+/*!
+ * Versión del protocolo acordada con el otro nodo durante el saludo:
+ * 1 para el protocolo de texto, 2 para el binario, 3 para el binario con
+ * jugadas (GameDelta) en lugar del estado completo, 4 si además se pueden
+ * reanudar las partidas (SessionToken y 'resume=' en el saludo) y 5 si el
+ * saludo trae el puerto del servidor de quien lo manda ('listen=').
  */
-bool Connection::sendMessage(const QString &message)
+int Connection::protocolVersion() const
 {
-    if (message.isEmpty())
-        return false;
+    return peerProtocolVersion;
+}
+
+/*!
+ * Opciones de socket con las que se configuran las conexiones nuevas.
+ */
+Connection::SocketSettings Connection::socketSettings()
+{
+    return currentSettings();
+}
 
-    QByteArray msg = message.toUtf8();
-    QByteArray data = "MESSAGE " + QByteArray::number(msg.size()) + ' ' + msg;
-    qDebug()<<"sendMessage:"<<data;
-    return write(data) == data.size();
+/*!
+ * Cambia las opciones de socket de las conexiones que se establezcan después;
+ * se debe llamar al arrancar, antes de crear conexiones en otros hilos.
+ */
+void Connection::setSocketSettings(const SocketSettings &settings)
+{
+    currentSettings() = settings;
 }
 
 /*!
-  Crea un temporizador para controlar el tiempo de tranferencia no pase de un valor determinado
+ * Aplica las opciones en cuanto el socket queda conectado, tanto al aceptar una
+ * conexión (setSocketDescriptor) como al terminar connectToHost(). Los tiempos de
+ * los sondeos solo se pueden ajustar en Linux; en otros sistemas se usan los del sistema.
  */
-void Connection::timerEvent(QTimerEvent *timerEvent)
+void Connection::applySocketSettings(QAbstractSocket::SocketState socketState)
 {
-    if (timerEvent->timerId() == transferTimerId) {
-        abort();
-        killTimer(transferTimerId);
-        transferTimerId = 0;
+    if (socketState != QAbstractSocket::ConnectedState)
+        return;
+
+    const SocketSettings &settings = currentSettings();
+    setSocketOption(QAbstractSocket::LowDelayOption, settings.lowDelay ? 1 : 0);
+    if (settings.keepAliveIdle <= 0)
+        return;
+
+    setSocketOption(QAbstractSocket::KeepAliveOption, 1);
+#ifdef Q_OS_LINUX
+    const int fd = int(socketDescriptor());
+    const int options[] = { TCP_KEEPIDLE, TCP_KEEPINTVL, TCP_KEEPCNT };
+    const int values[] = { settings.keepAliveIdle, settings.keepAliveInterval,
+                           settings.keepAliveCount };
+    for (int i = 0; i < 3; ++i) {
+        if (values[i] > 0)
+            setsockopt(fd, IPPROTO_TCP, options[i], &values[i], sizeof(values[i]));
     }
+#endif
 }
 
 /*!
-  Asegura que la conexión está lista para ser usada, y por medio del mensaje de saludo Greeting
-  se guarda el hostname del nodo que se acaba de conectar en la variable username
+ * Tiempo de ida y vuelta suavizado en microsegundos (como el SRTT de TCP), o -1
+ * si aún no hay ninguna medición. Se puede consultar desde cualquier hilo, por
+ * ejemplo para preferir a los nodos con menor latencia al emparejar.
  */
-void Connection::processReadyRead()
+qint64 Connection::roundTripTime() const
 {
-    if (state == WaitingForGreeting) {
-        if (!readProtocolHeader())
-            return;
-        if (currentDataType != Greeting) {
-            abort();
-            return;
-        }
-        state = ReadingGreeting;
-    }
+    return smoothedRtt.fetchAndAddRelaxed(0);
+}
 
-    if (state == ReadingGreeting) {
-        if (!hasEnoughData())
-            return;
+/*!
+ * Todas las mediciones de ida y vuelta de la conexión, en microsegundos, con su
+ * mínimo, promedio y percentiles. Solo se debe leer desde el hilo de la conexión.
+ */
+const LatencyHistogram &Connection::roundTripTimes() const
+{
+    return rttHistogram;
+}
 
-        buffer = read(numBytesForCurrentDataType);
-        if (buffer.size() != numBytesForCurrentDataType) {
-            abort();
-            return;
-        }
+/*!
+ * Milisegundos entre pings en este momento; ver peerActive().
+ */
+int Connection::pingInterval() const
+{
+    return currentPingInterval;
+}
 
-        username = QString(buffer) + '@' + peerAddress().toString() + ':'
-                   + QString::number(peerPort());
-        currentDataType = Undefined;
-        numBytesForCurrentDataType = 0;
-        buffer.clear();
+/*!
+ * Manda un ping ahora mismo para medir la latencia, sin esperar al siguiente.
+ */
+void Connection::measureRoundTrip()
+{
+    if (state == ReadyForUse && isGreetingMessageSent)
+        sendPing();
+}
 
-        if (!isValid()) {
-            abort();
-            return;
-        }
+/*!
+ * Pide reanudar una partida en lugar de empezar una nueva: el saludo lleva el
+ * token que nos dio el otro nodo y cuántos estados del juego recibimos de él
+ * (ej. 'usuario;resume=token:5;proto=4'). Se debe llamar antes de mandar el saludo.
+ */
+void Connection::setResumeRequest(const QByteArray &token, quint32 seen)
+{
+    resumeRequest = token + ':' + QByteArray::number(seen);
+}
 
-        if (!isGreetingMessageSent)
-            sendGreetingMessage();
+/*!
+ * Token con el que el otro nodo pidió reanudar su partida en el saludo, o vacío.
+ */
+QByteArray Connection::peerResumeToken() const
+{
+    return peerResume.left(peerResume.lastIndexOf(':'));
+}
+
+/*!
+ * Estados del juego que el otro nodo dice haber recibido de nosotros en la partida que reanuda.
+ */
+quint32 Connection::peerResumeSeen() const
+{
+    return peerResume.mid(peerResume.lastIndexOf(':') + 1).toUInt();
+}
 
-        pingTimer.start();
-        pongTime.start();
-        state = ReadyForUse;
-        emit readyForUse();
+/*!
+ * Le da al otro nodo el token con el que puede reanudar la partida si la conexión
+ * se cae; uno vacío le avisa que ya no se podrá reanudar (ej. al cerrar el programa).
+ * Solo los nodos con la versión 4 del protocolo lo entienden.
+ */
+bool Connection::sendSessionToken(const QByteArray &token)
+{
+    if (peerProtocolVersion < 4)
+        return false;
+    return writeFrame(FrameScanner::SessionToken, token);
+}
+
+/*!
+ * Al reanudar una partida en una conexión nueva: el último estado que el otro
+ * nodo recibió de nosotros y el último que recibimos de él. Los estados
+ * siguientes salen como jugadas sobre ellos, igual que en la conexión anterior.
+ */
+void Connection::setGameStateBases(const GameState &sent, const GameState &received)
+{
+    sentState = sent;
+    sentMoves = 0;
+    sentHash = sent.hash();
+    receivedState = received;
+    receivedMoves = 0;
+    receivedHash = received.hash();
+    awaitingSnapshot = false;
+}
+
+/*!
+ * Escribe el mensaje al flujo de datos de la conexión.
+ */
+bool Connection::sendMessage(const QString &message)
+{
+    if (message.isEmpty())
+        return false;
+
+    return writeFrame(FrameScanner::PlainText, message.toUtf8());
+}
+
+/*!
+ * Escribe un mensaje ya codificado, compartido con otras conexiones, sin volver
+ * a codificarlo. Regresa el número de bytes puestos en la cola de escritura, o -1
+ * si no se pudo escribir; también si aún no mandamos nuestro saludo (ej. un nodo
+ * que el matchmaker tiene en espera), porque el otro lado cortaría la conexión.
+ */
+qint64 Connection::sendFrame(const OutgoingFrame &frame)
+{
+    if (frame.isEmpty() || state != ReadyForUse || !isGreetingMessageSent)
+        return -1;
+
+    if (peerProtocolVersion < 2) {
+        const QByteArray &data = frame.textFrame();
+        if (!queueOutput(data))
+            return -1;
+        Metrics::frameOut(FrameScanner::PlainText, data.size());
+        Metrics::add(Metrics::BytesOut, data.size());
+        return data.size();
     }
 
-    do {
-        if (currentDataType == Undefined) {
-            if (!readProtocolHeader())
-                return;
-        }
-        if (!hasEnoughData())
-            return;
-        processData();
-    } while (bytesAvailable() > 0);
+    // Un estado completo pasa a ser la base de las jugadas siguientes
+    if (frame.binaryType() == FrameScanner::PackedState) {
+        sentState = frame.gameState();
+        sentMoves = 0;
+        sentHash = frame.stateHash();
+    }
+
+    const QByteArray &payload = frame.binaryPayload();
+    QByteArray header = FrameScanner::binaryHeader(frame.binaryType(), ++outgoingSequence,
+                                                   payload.size());
+    if (header.isEmpty() || !queueOutput(header) || !queueOutput(payload))
+        return -1;
+    Metrics::frameOut(frame.binaryType(), payload.size());
+    Metrics::add(Metrics::BytesOut, header.size() + payload.size());
+    return header.size() + payload.size();
+}
+
+/*
+ * Indica si next es base más una jugada. Si la partida de base ya terminó, next
+ * es el inicio de otra y se compara contra el tablero vacío, igual que hace
+ * GameDelta::applyTo() del otro lado.
+ */
+static bool followsFrom(const GameState &next, const GameState &base, int *cell)
+{
+    if (base.status == GameState::Playing)
+        return next.followsFrom(base, cell);
+    return next.followsFrom(GameState(base.rows, base.columns, base.winLength), cell);
 }
 
 /*!
-  Manda un mensaje de ping y comprueba si el tiempo de respuesta (Pong) es mayor
-  al definido, de ser así, manda de nuevo el mensaje de Ping.
+ * Manda el estado del juego. Con la versión 3 del protocolo, si el otro nodo ya
+ * tiene el estado anterior y solo cambió una casilla, se manda solo la jugada
+ * (11 bytes sin importar el tamaño del tablero); si no, o con la versión 2, va
+ * el estado completo empaquetado. Los nodos anteriores lo reciben en texto.
  */
-void Connection::sendPing()
+bool Connection::sendGameState(const GameState &gameState)
 {
-    if (pongTime.elapsed() > PongTimeout) {
-        abort();
-        return;
+    if (peerProtocolVersion < 2)
+        return writeFrame(FrameScanner::PlainText, gameState.toText());
+
+    int cell;
+    if (peerProtocolVersion < 3 || !followsFrom(gameState, sentState, &cell))
+        return sendSnapshot(gameState, gameState.hash());
+
+    GameDelta delta;
+    delta.sequence = ++sentMoves;
+    delta.cell = cell;
+    delta.status = gameState.status;
+    delta.senderMark = gameState.senderMark;
+    if (sentState.status != GameState::Playing)
+        sentHash = 0;
+    if (cell != GameDelta::NoCell) {
+        delta.mark = gameState.cells.at(cell);
+        sentHash ^= GameState::cellKey(cell, delta.mark);
     }
+    delta.boardHash = sentHash;
+    sentState = gameState;
+    return writeFrame(FrameScanner::MoveDelta, delta.pack());
+}
 
-    write("PING 1 p");
+/*!
+ * Manda el estado completo, que reinicia la cuenta de jugadas de ambos lados.
+ */
+bool Connection::sendSnapshot(const GameState &gameState, quint32 hash)
+{
+    sentState = gameState;
+    sentMoves = 0;
+    sentHash = hash;
+    return writeFrame(FrameScanner::PackedState, gameState.pack());
 }
 
 /*!
-  Manda nuestro usuario en forma de primer mensaje con fines de identificación.
+ * Compone la trama con el protocolo acordado y la pone en la cola de salida.
  */
-void Connection::sendGreetingMessage()
+bool Connection::writeFrame(FrameScanner::DataType type, const QByteArray &payload)
 {
-    QByteArray greeting = greetingMessage.toUtf8();
-    QByteArray data = "GREETING " + QByteArray::number(greeting.size()) + ' ' + greeting;
-    //qDebug()<<"sendGretingMsg"<<data;
-    if (write(data) == data.size())
-        isGreetingMessageSent = true;
+    QByteArray data = peerProtocolVersion >= 2
+            ? FrameScanner::binaryFrame(type, ++outgoingSequence, payload)
+            : FrameScanner::textFrame(type, payload);
+    if (data.isEmpty() || !queueOutput(data))
+        return false;
+    Metrics::frameOut(type, payload.size());
+    Metrics::add(Metrics::BytesOut, data.size());
+    return true;
 }
 
 /*!
-  Descifra si es un mensaje del tipo MESSAGE, PING, PONG o GREETING,
-  Y con ayuda de dataLengthForCurrentDataType() se obtiene el tamaño
-  del mensaje para leerlo del buffer
+  Los plazos de ping, de respuesta (Pong) y de transferencia no usan temporizadores
+  propios: se guardan como instantes de la rueda del hilo y la conexión se programa
+  solo para el más cercano. Moverlos a más tarde no toca la rueda; al vencer se
+  revisan todos y se vuelve a programar el siguiente.
  */
-int Connection::readDataIntoBuffer(int maxSize)
+void Connection::timeout()
 {
-    if (maxSize > MaxBufferSize)
-        return 0;
+    const qint64 now = wheel->now();
+    scheduledDeadline = 0;
 
-    int numBytesBeforeRead = buffer.size();
-    if (numBytesBeforeRead == MaxBufferSize) {
+    // Se dejó de recibir una trama a medias, o el otro nodo no contesta los pings
+    if (transferDeadline && now >= transferDeadline) {
+        Metrics::add(Metrics::TransferTimeouts);
+        abort();
+        return;
+    }
+    if (pongDeadline && now >= pongDeadline) {
+        Metrics::add(Metrics::PongTimeouts);
         abort();
-        return 0;
+        return;
     }
 
-    /* Una vez usado read(), los bytes leídos dejan de estar disponibles
-     * En una primera iteración leerá el tipo del mensaje, ej. 'MESSAGE '
-     * Posteriormente, cuando de llame de nuevo la función leerá el número
-     * de bytes del mensaje en sí, ej. '5 ' porque la primera parte ('MESSAGE ')
-     * ya no está disponible en el buffer.
-     */
-    while (bytesAvailable() > 0 && buffer.size() < maxSize) {
-        buffer.append(read(1));
-        if (buffer.endsWith(SeparatorToken))
-            break;
+    // Mientras no haya partida en curso cada ping espera el doble que el anterior
+    if (pingDeadline && now >= pingDeadline) {
+        sendPing();
+        pingDeadline = now + currentPingInterval;
+        currentPingInterval = qMin(currentPingInterval * 2, MaxPingInterval);
     }
-    return buffer.size() - numBytesBeforeRead;
+    updateTimers();
 }
 
 /*!
-  Regresa el número de bytes a leer del mensaje en sí.
+  Empieza a mandar pings una vez que ambos saludos se mandaron.
  */
-int Connection::dataLengthForCurrentDataType()
+void Connection::startKeepAlive()
 {
-    if (bytesAvailable() <= 0 || readDataIntoBuffer() <= 0
-            || !buffer.endsWith(SeparatorToken))
-        return 0;
+    const qint64 now = wheel->now();
+    currentPingInterval = MinPingInterval;
+    pingDeadline = now + currentPingInterval;
+    pongDeadline = now + PongTimeout;
+    updateTimers();
+}
 
-    // Se elminia el espacio final del mensaje para obtener solo el número
-    // de bytes que nos interesa leer del buffer
-    buffer.chop(1);
-    int number = buffer.toInt();
+/*!
+  Programa la conexión en la rueda solo si el plazo más cercano es anterior al
+  que ya estaba programado.
+ */
+void Connection::updateTimers()
+{
+    qint64 next = 0;
+    const qint64 deadlines[] = { pingDeadline, pongDeadline, transferDeadline };
+    for (int i = 0; i < 3; ++i) {
+        if (deadlines[i] && (!next || deadlines[i] < next))
+            next = deadlines[i];
+    }
 
-    buffer.clear();
-    return number;
+    if (!next) {
+        if (isScheduled())
+            wheel->cancel(this);
+        scheduledDeadline = 0;
+    } else if (!isScheduled() || next < scheduledDeadline) {
+        wheel->schedule(this, next - wheel->now());
+        scheduledDeadline = next;
+    }
 }
 
 /*!
-  Lee el tipo de mensaje que está en el buffer y mediante dataLengthForCurrentDataType()
-  detecta el número de bytes a leer del mensaje.
-*/
-bool Connection::readProtocolHeader()
+ * Junta todas las tramas que se producen en una misma vuelta del ciclo de eventos
+ * (ej. un aviso, un pong y una jugada) y las manda con una sola escritura al
+ * terminar la vuelta, sin esperar a que el socket pida más datos. Con TCP_NODELAY
+ * eso es una sola llamada al sistema y un solo segmento.
+ */
+bool Connection::queueOutput(const QByteArray &data)
 {
-    if (transferTimerId) {
-        killTimer(transferTimerId);
-        transferTimerId = 0;
+    if (!isOpen())
+        return false;
+
+    outputQueue += data;
+    if (!flushScheduled) {
+        flushScheduled = true;
+        QMetaObject::invokeMethod(this, "flushOutput", Qt::QueuedConnection);
     }
+    return true;
+}
 
-    if (readDataIntoBuffer() <= 0) {
-        transferTimerId = startTimer(TransferTimeout);
-        return false;
+/*!
+ * Escribe de inmediato lo que haya en la cola de salida. Se llama sola al final
+ * de la vuelta del ciclo de eventos; llamarla antes solo adelanta la escritura.
+ */
+void Connection::flushOutput()
+{
+    flushScheduled = false;
+    if (outputQueue.isEmpty())
+        return;
+
+    QByteArray data;
+    data.swap(outputQueue);
+    if (QAbstractSocket::state() != QAbstractSocket::ConnectedState)
+        return;
+    write(data);
+    flush();
+    Metrics::add(Metrics::OutputFlushes);
+}
+
+void Connection::stopTimers()
+{
+    outputQueue.clear();
+    pingDeadline = 0;
+    pongDeadline = 0;
+    transferDeadline = 0;
+    updateTimers();
+}
+
+/*!
+  Lee los bytes disponibles en pedazos de a lo más MaxBufferSize y procesa todas
+  las tramas completas de cada pedazo antes de leer el siguiente, así una ráfaga
+  grande de tramas válidas no llena el buffer. La primera trama debe ser el
+  saludo (Greeting), con el que se guarda el hostname del nodo que se acaba de
+  conectar en la variable peerNick. Si queda una trama incompleta se conserva
+  hasta la siguiente lectura; solo ella está limitada, a MaxFrameSize.
+ */
+void Connection::processReadyRead()
+{
+    bool progress = false;
+    while (isValid()) {
+        const QByteArray received = read(MaxBufferSize);
+        if (received.isEmpty())
+            break;
+        Metrics::add(Metrics::BytesIn, received.size());
+        scanner.append(received);
+        if (!processFrames(&progress))
+            return;
+        if (scanner.pendingBytes() > FrameScanner::MaxFrameSize) {
+            Metrics::add(Metrics::BufferOverflowAborts);
+            abort();
+            return;
+        }
     }
 
-    if (buffer == "PING ") {
-        currentDataType = Ping;
-    } else if (buffer == "PONG ") {
-        currentDataType = Pong;
-    } else if (buffer == "MESSAGE ") {
-        currentDataType = PlainText;
-    } else if (buffer == "GREETING ") {
-        currentDataType = Greeting;
-    } else {
-        currentDataType = Undefined;
-        abort();
-        return false;
+    // El plazo de transferencia solo corre mientras hay una trama a medias
+    if (scanner.isEmpty()) {
+        transferDeadline = 0;
+    } else if (progress || !transferDeadline) {
+        scanner.squeeze();
+        transferDeadline = wheel->now() + TransferTimeout;
+        updateTimers();
     }
+}
 
-    buffer.clear();
-    numBytesForCurrentDataType = dataLengthForCurrentDataType();
+/*!
+  Procesa todas las tramas completas que hay en el buffer. Regresa false si la
+  conexión se cerró por una trama inválida.
+ */
+bool Connection::processFrames(bool *progress)
+{
+    FrameScanner::DataType type;
+    QByteArray data;
+    quint32 sequence;
+    while (isValid()) {
+        FrameScanner::Result result = scanner.next(&type, &data, &sequence);
+        if (result == FrameScanner::NeedMoreData)
+            break;
+        if (result == FrameScanner::InvalidData) {
+            Metrics::add(state == WaitingForGreeting ? Metrics::HandshakesFailed
+                                                     : Metrics::ParseErrors);
+            abort();
+            return false;
+        }
+        *progress = true;
+        Metrics::frameIn(type, data.size());
+
+        if (state == WaitingForGreeting) {
+            if (type != FrameScanner::Greeting || !processGreeting(data)) {
+                Metrics::add(Metrics::HandshakesFailed);
+                abort();
+                return false;
+            }
+            continue;
+        }
+        if (!processData(type, data, sequence)) {
+            Metrics::add(Metrics::ParseErrors);
+            abort();
+            return false;
+        }
+    }
     return true;
 }
 
 /*!
-  Comprueba que hay suficientes bytes en el buffer para trabajar
+  Manda un ping con la marca de tiempo actual en microsegundos; el otro nodo la
+  regresa tal cual en el Pong y así se mide el tiempo de ida y vuelta.
+ */
+void Connection::sendPing()
+{
+    pingStamp = qMax(qint64(1), monotonicMicroseconds());
+    writeFrame(FrameScanner::Ping, QByteArray::number(pingStamp));
+}
+
+/*!
+  Cualquier trama del otro nodo demuestra que sigue vivo y recorre el plazo de
+  respuesta. El tráfico de la partida además regresa los pings a su intervalo
+  mínimo, para tener mediciones recientes mientras se juega; un enlace ocioso
+  se revisa cada vez menos, hasta MaxPingInterval.
+ */
+void Connection::peerActive(bool gameTraffic)
+{
+    if (!pongDeadline)
+        return;
+
+    const qint64 now = wheel->now();
+    pongDeadline = now + PongTimeout;
+    if (gameTraffic && currentPingInterval > MinPingInterval) {
+        currentPingInterval = MinPingInterval;
+        if (pingDeadline > now + currentPingInterval) {
+            pingDeadline = now + currentPingInterval;
+            updateTimers();
+        }
+    }
+}
+
+/*!
+  Registra el tiempo de ida y vuelta si el Pong trae la marca del último ping.
+  Los nodos anteriores contestan siempre 'p', eso solo cuenta como señal de vida.
+ */
+void Connection::processPong(const QByteArray &data)
+{
+    bool ok;
+    const qint64 stamp = data.toLongLong(&ok);
+    if (!ok || !pingStamp || stamp != pingStamp)
+        return;
+    pingStamp = 0;
+
+    const qint64 rtt = qMin(monotonicMicroseconds() - stamp, qint64(INT_MAX));
+    rttHistogram.record(rtt);
+    const int previous = smoothedRtt.fetchAndAddRelaxed(0);
+    smoothedRtt.fetchAndStoreRelaxed(previous < 0 ? int(rtt) : int(previous + (rtt - previous) / 8));
+}
+
+/*!
+  Manda nuestro usuario en forma de primer mensaje con fines de identificación,
+  junto con la versión de protocolo más alta que soportamos (ej. 'usuario;proto=2').
+  El saludo siempre va en el protocolo de texto para que lo entiendan versiones anteriores.
  */
-bool Connection::hasEnoughData()
+void Connection::sendGreetingMessage()
 {
-    if (transferTimerId) {
-        QObject::killTimer(transferTimerId);
-        transferTimerId = 0;
+    QByteArray greeting = greetingMessage.toUtf8();
+    if (localServerPort)
+        greeting += ListenTag + QByteArray::number(localServerPort);
+    if (!resumeRequest.isEmpty())
+        greeting += ResumeTag + resumeRequest;
+    greeting += ProtocolTag + QByteArray::number(LocalProtocolVersion);
+    QByteArray data = FrameScanner::textFrame(FrameScanner::Greeting, greeting);
+    //qDebug()<<"sendGretingMsg"<<data;
+    if (queueOutput(data)) {
+        Metrics::frameOut(FrameScanner::Greeting, greeting.size());
+        Metrics::add(Metrics::BytesOut, data.size());
+        isGreetingMessageSent = true;
+        if (state == ReadyForUse)
+            startKeepAlive();
     }
+}
 
-    if (numBytesForCurrentDataType <= 0)
-        numBytesForCurrentDataType = dataLengthForCurrentDataType();
+/*!
+  Guarda el nombre del nodo remoto, acuerda la versión del protocolo y deja la
+  conexión lista para ser usada. Un saludo sin versión viene de un nodo anterior,
+  con el que se sigue usando el protocolo de texto.
+ */
+bool Connection::processGreeting(const QByteArray &greeting)
+{
+    QByteArray name = greeting;
+    int version = 1;
+    int tag = greeting.lastIndexOf(ProtocolTag);
+    if (tag != -1) {
+        bool ok;
+        int advertised = greeting.mid(tag + sizeof(ProtocolTag) - 1).toInt(&ok);
+        if (ok && advertised > 0) {
+            version = advertised;
+            name = greeting.left(tag);
+        }
+    }
+    int resume = name.lastIndexOf(ResumeTag);
+    if (resume != -1 && version >= 4) {
+        peerResume = name.mid(resume + sizeof(ResumeTag) - 1);
+        name.truncate(resume);
+    }
+    quint16 listenPort = 0;
+    int listen = name.lastIndexOf(ListenTag);
+    if (listen != -1 && version >= 5) {
+        listenPort = name.mid(listen + sizeof(ListenTag) - 1).toUShort();
+        name.truncate(listen);
+    }
+
+    peerNick = internName(name);
+    peerHost = peerAddress();
+    peerHostPort = listenPort ? listenPort : peerPort();
 
-    if (bytesAvailable() < numBytesForCurrentDataType
-            || numBytesForCurrentDataType <= 0) {
-        transferTimerId = startTimer(TransferTimeout);
+    if (!isValid())
         return false;
+
+    // Todo lo que sigue al saludo, en ambos sentidos, usa el protocolo acordado
+    peerProtocolVersion = qMin(version, LocalProtocolVersion);
+    scanner.setBinaryFraming(peerProtocolVersion >= 2);
+    state = ReadyForUse;
+    Metrics::add(Metrics::HandshakesCompleted);
+
+    // Los pings solo empiezan cuando ambos saludos ya se mandaron
+    if (isGreetingMessageSent)
+        startKeepAlive();
+    else if (!greetingDeferred) {
+        sendGreetingMessage();
     }
 
+    emit readyForUse();
     return true;
 }
 
 /*!
-  En este punto ya tenemos el tamaño de bytes que tiene el mensaje, ahora solo queda
-  leerlo y emitir la señal de nuevo Mensaje pasándole como argumento el buffer con el mensaje
-  para que lo procese el motor del juego.
+  En este punto ya tenemos el mensaje completo, solo queda emitir la señal de nuevo
+  Mensaje pasándole como argumento el mensaje para que lo procese el motor del juego.
+  Con el protocolo binario además se comprueba que no falte ninguna trama.
  */
-void Connection::processData()
+bool Connection::processData(FrameScanner::DataType type, const QByteArray &data,
+                             quint32 sequence)
 {
-    buffer = read(numBytesForCurrentDataType);
-    if (buffer.size() != numBytesForCurrentDataType) {
-        abort();
-        return;
-    }
+    if (scanner.binaryFraming() && sequence != ++incomingSequence)
+        return false;
+
+    peerActive(type == FrameScanner::PlainText || type == FrameScanner::PackedState
+               || type == FrameScanner::MoveDelta);
 
-    switch (currentDataType) {
-    case PlainText:
-        emit newMessage(QString::fromUtf8(buffer));
+    GameState gameState;
+    switch (type) {
+    case FrameScanner::PlainText:
+        if (GameState::fromText(data, &gameState))
+            emit newGameState(gameState);
+        else
+            emit newMessage(QString::fromUtf8(data));
+        break;
+    case FrameScanner::PackedState:
+        if (!GameState::unpack(data, &gameState))
+            return false;
+        receivedState = gameState;
+        receivedMoves = 0;
+        receivedHash = gameState.hash();
+        awaitingSnapshot = false;
+        emit newGameState(gameState);
+        break;
+    case FrameScanner::MoveDelta:
+        return processDelta(data);
+    case FrameScanner::ResyncRequest:
+        sendSnapshot(sentState, sentHash);
         break;
-    case Ping:
-        write("PONG 1 p");
+    case FrameScanner::SessionToken:
+        emit sessionToken(data);
         break;
-    case Pong:
-        pongTime.restart();
+    case FrameScanner::Ping:
+        writeFrame(FrameScanner::Pong, data.size() <= MaxEchoSize ? data : QByteArray("p"));
+        break;
+    case FrameScanner::Pong:
+        processPong(data);
         break;
     default:
         break;
     }
+    return true;
+}
+
+/*!
+  Aplica una jugada sobre nuestra copia del estado del otro nodo y la emite como
+  estado completo. Si falta una jugada o el hash no coincide se pide el estado
+  completo y se ignoran las jugadas hasta que llegue.
+ */
+bool Connection::processDelta(const QByteArray &data)
+{
+    GameDelta delta;
+    if (!GameDelta::unpack(data, &delta))
+        return false;
+    if (awaitingSnapshot)
+        return true;
+
+    if (delta.sequence != receivedMoves + 1
+            || !delta.applyTo(&receivedState, &receivedHash)
+            || receivedHash != delta.boardHash) {
+        requestResync();
+        return true;
+    }
+    receivedMoves = delta.sequence;
+    emit newGameState(receivedState);
+    return true;
+}
 
-    currentDataType = Undefined;
-    numBytesForCurrentDataType = 0;
-    buffer.clear();
+void Connection::requestResync()
+{
+    awaitingSnapshot = true;
+    Metrics::add(Metrics::StateResyncs);
+    writeFrame(FrameScanner::ResyncRequest, QByteArray());
 }
@@ -2,67 +2,134 @@
 #define CONNECTION_H
 
 #include <QtNetwork>
+#include <QAtomicInt>
 #include <QHostAddress>
 #include <QString>
 #include <QTcpSocket>
-#include <QTime>
-#include <QTimer>
 
-static const int MaxBufferSize = 1024000;
+#include "framescanner.h"
+#include "gamestate.h"
+#include "latencyhistogram.h"
+#include "timerwheel.h"
 
-class Connection : public QTcpSocket
+class OutgoingFrame;
+
+static const int LocalProtocolVersion = 5;
+
+class Connection : public QTcpSocket, private TimerWheel::Entry
 {
     Q_OBJECT
 
 public:
     enum ConnectionState {
         WaitingForGreeting,
-        ReadingGreeting,
         ReadyForUse
     };
-    enum DataType {
-        PlainText,
-        Ping,
-        Pong,
-        Greeting,
-        Undefined
+
+    /* Opciones del socket TCP; ver setSocketSettings() */
+    struct SocketSettings {
+        SocketSettings();
+
+        bool lowDelay;          // TCP_NODELAY: sin algoritmo de Nagle
+        int keepAliveIdle;      // segundos sin tráfico antes del primer sondeo, 0 = apagado
+        int keepAliveInterval;  // segundos entre sondeos
+        int keepAliveCount;     // sondeos sin respuesta antes de cerrar
     };
 
     Connection(QObject *parent = 0);
+    ~Connection();
+
+    static void *operator new(size_t size);
+    static void operator delete(void *pointer, size_t size);
 
     QString name() const;
     void setGreetingMessage(const QString &message);
+    void setGreetingDeferred(bool deferred);
+    void setServerPort(quint16 port);
+    quint16 peerServerPort() const;
+    bool isGreetingSent() const;
+    int protocolVersion() const;
+    qint64 roundTripTime() const;
+    const LatencyHistogram &roundTripTimes() const;
+    int pingInterval() const;
     bool sendMessage(const QString &message);
+    qint64 sendFrame(const OutgoingFrame &frame);
+    void measureRoundTrip();
+    void setResumeRequest(const QByteArray &token, quint32 seen);
+    QByteArray peerResumeToken() const;
+    quint32 peerResumeSeen() const;
+    bool sendSessionToken(const QByteArray &token);
+    void setGameStateBases(const GameState &sent, const GameState &received);
+
+    static SocketSettings socketSettings();
+    static void setSocketSettings(const SocketSettings &settings);
 
 signals:
     void readyForUse(); // Recibe Client
     void newMessage(const QString &message); // La recibe Client que a su vez la manda a la ui
+    void newGameState(const GameState &gameState);
+    void sessionToken(const QByteArray &token);
 
-protected:
-    void timerEvent(QTimerEvent *timerEvent);
+public slots:
+    bool sendGameState(const GameState &gameState);
+    void sendGreetingMessage();
+    void flushOutput();
 
 private slots:
     void processReadyRead();
-    void sendPing();
-    void sendGreetingMessage();
+    void stopTimers();
+    void applySocketSettings(QAbstractSocket::SocketState socketState);
 
 private:
-    int readDataIntoBuffer(int maxSize = MaxBufferSize);
-    int dataLengthForCurrentDataType();
-    bool readProtocolHeader();
-    bool hasEnoughData();
-    void processData();
+    void timeout();
+    void startKeepAlive();
+    void updateTimers();
+    void sendPing();
+    void peerActive(bool gameTraffic);
+    void processPong(const QByteArray &data);
+    bool processFrames(bool *progress);
+    bool writeFrame(FrameScanner::DataType type, const QByteArray &payload);
+    bool queueOutput(const QByteArray &data);
+    bool processGreeting(const QByteArray &greeting);
+    bool processData(FrameScanner::DataType type, const QByteArray &data, quint32 sequence);
+    bool sendSnapshot(const GameState &gameState, quint32 hash);
+    bool processDelta(const QByteArray &data);
+    void requestResync();
 
     QString greetingMessage;
-    QString username;
-    QTimer pingTimer;
-    QTime pongTime;
-    QByteArray buffer;
+    QByteArray resumeRequest;
+    QByteArray peerResume;
+    QByteArray peerNick;
+    QHostAddress peerHost;
+    quint16 peerHostPort;
+    quint16 localServerPort;
+    TimerWheel *wheel;
+    qint64 pingDeadline;
+    qint64 pongDeadline;
+    qint64 transferDeadline;
+    qint64 scheduledDeadline;
+    qint64 pingStamp;
+    int currentPingInterval;
+    QAtomicInt smoothedRtt;
+    LatencyHistogram rttHistogram;
+    FrameScanner scanner;
+    QByteArray outputQueue;
+    bool flushScheduled;
     ConnectionState state;
-    DataType currentDataType;
-    int numBytesForCurrentDataType;
-    int transferTimerId;
+    int peerProtocolVersion;
+    quint32 outgoingSequence;
+    quint32 incomingSequence;
+    GameState sentState;
+    GameState receivedState;
+    quint32 sentMoves;
+    quint32 receivedMoves;
+    quint32 sentHash;
+    quint32 receivedHash;
+    bool awaitingSnapshot;
     bool isGreetingMessageSent;
+    bool greetingDeferred;
 };
 
+Q_DECLARE_METATYPE(Connection *)
+
 #endif
@@ -0,0 +1,99 @@
+#include "connectionregistry.h"
+#include "connection.h"
+
+ConnectionRegistry::ConnectionRegistry()
+{
+}
+
+/*!
+  Registra la conexión, ya con el saludo del otro nodo. Regresa false si ya
+  había otra conexión con el mismo nodo o si la conexión ya estaba registrada.
+ */
+bool ConnectionRegistry::insert(Connection *connection)
+{
+    const Key key(connection->peerAddress(), connection->peerServerPort());
+    if (byConnection.contains(connection) || byKey.contains(key))
+        return false;
+
+    Entry entry;
+    entry.key = key;
+    entry.sessionId = 0;
+    byConnection.insert(connection, entry);
+    byKey.insert(key, connection);
+    return true;
+}
+
+/*!
+  Da de baja solo esta conexión, aunque haya otras desde la misma dirección.
+ */
+bool ConnectionRegistry::remove(Connection *connection)
+{
+    QHash<Connection *, Entry>::iterator it = byConnection.find(connection);
+    if (it == byConnection.end())
+        return false;
+
+    const Entry entry = it.value();
+    byConnection.erase(it);
+    byKey.remove(entry.key);
+
+    if (entry.sessionId)
+        bySession.remove(entry.sessionId, connection);
+    return true;
+}
+
+bool ConnectionRegistry::contains(Connection *connection) const
+{
+    return byConnection.contains(connection);
+}
+
+bool ConnectionRegistry::contains(const QHostAddress &address, quint16 port) const
+{
+    return byKey.contains(Key(address, port));
+}
+
+Connection *ConnectionRegistry::find(const QHostAddress &address, quint16 port) const
+{
+    return byKey.value(Key(address, port));
+}
+
+/*!
+  Asocia la conexión a una partida; con identificador 0 la saca de su partida.
+ */
+void ConnectionRegistry::setSession(Connection *connection, quint32 sessionId)
+{
+    QHash<Connection *, Entry>::iterator it = byConnection.find(connection);
+    if (it == byConnection.end() || it->sessionId == sessionId)
+        return;
+
+    if (it->sessionId)
+        bySession.remove(it->sessionId, connection);
+    it->sessionId = sessionId;
+    if (sessionId)
+        bySession.insert(sessionId, connection);
+}
+
+QList<Connection *> ConnectionRegistry::sessionConnections(quint32 sessionId) const
+{
+    return bySession.values(sessionId);
+}
+
+quint32 ConnectionRegistry::sessionOf(Connection *connection) const
+{
+    QHash<Connection *, Entry>::const_iterator it = byConnection.constFind(connection);
+    return it == byConnection.constEnd() ? 0 : it->sessionId;
+}
+
+QList<Connection *> ConnectionRegistry::connections() const
+{
+    return byConnection.keys();
+}
+
+int ConnectionRegistry::size() const
+{
+    return byConnection.size();
+}
+
+bool ConnectionRegistry::isEmpty() const
+{
+    return byConnection.isEmpty();
+}
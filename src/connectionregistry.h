@@ -0,0 +1,52 @@
+#ifndef CONNECTIONREGISTRY_H
+#define CONNECTIONREGISTRY_H
+
+#include <QHash>
+#include <QHostAddress>
+#include <QList>
+#include <QPair>
+
+class Connection;
+
+/*
+ * Registro de conexiones abiertas con búsqueda, alta y baja en O(1) por
+ * (dirección, puerto del servidor del otro nodo) y por identificador de
+ * partida. Varios nodos detrás de la misma dirección (NAT o varias instancias
+ * en un equipo) se distinguen por el puerto, que es el mismo que anuncian en
+ * sus datagramas, también en las conexiones que ellos iniciaron (ver
+ * Connection::peerServerPort()). La clave se guarda al registrar la conexión
+ * porque el socket olvida la dirección del otro nodo en cuanto se desconecta.
+ */
+class ConnectionRegistry
+{
+public:
+    typedef QPair<QHostAddress, quint16> Key;
+
+    ConnectionRegistry();
+
+    bool insert(Connection *connection);
+    bool remove(Connection *connection);
+    bool contains(Connection *connection) const;
+    bool contains(const QHostAddress &address, quint16 port) const;
+    Connection *find(const QHostAddress &address, quint16 port) const;
+
+    void setSession(Connection *connection, quint32 sessionId);
+    QList<Connection *> sessionConnections(quint32 sessionId) const;
+    quint32 sessionOf(Connection *connection) const;
+
+    QList<Connection *> connections() const;
+    int size() const;
+    bool isEmpty() const;
+
+private:
+    struct Entry {
+        Key key;
+        quint32 sessionId;
+    };
+
+    QHash<Key, Connection *> byKey;
+    QHash<Connection *, Entry> byConnection;
+    QMultiHash<quint32, Connection *> bySession;
+};
+
+#endif
@@ -0,0 +1,45 @@
+# Red, protocolo y motor del juego, sin dependencias de la interfaz gráfica.
+# Lo comparten el cliente gráfico y el servidor dedicado.
+
+INCLUDEPATH += $$PWD
+DEPENDPATH += $$PWD
+
+# La tabla del tablero de 3x3 se resuelve con constexpr al compilar
+CONFIG += c++14
+lessThan(QT_MAJOR_VERSION, 5): QMAKE_CXXFLAGS += -std=c++14
+*clang*: QMAKE_CXXFLAGS += -fconstexpr-steps=100000000
+
+SOURCES	+=  $$PWD/aiplayer.cpp \
+	    $$PWD/connection.cpp \
+	    $$PWD/connectionregistry.cpp \
+	    $$PWD/discoveryschedule.cpp \
+	    $$PWD/framescanner.cpp \
+	    $$PWD/gameengine.cpp \
+	    $$PWD/gamejournal.cpp \
+	    $$PWD/gamestate.cpp \
+	    $$PWD/latencyhistogram.cpp \
+	    $$PWD/matchmaker.cpp \
+	    $$PWD/metrics.cpp \
+	    $$PWD/metricsendpoint.cpp \
+	    $$PWD/outgoingframe.cpp \
+	    $$PWD/server.cpp \
+	    $$PWD/solvedtable.cpp \
+	    $$PWD/timerwheel.cpp
+
+HEADERS  += $$PWD/aiplayer.h \
+	    $$PWD/connection.h \
+	    $$PWD/connectionregistry.h \
+	    $$PWD/discoveryschedule.h \
+	    $$PWD/framescanner.h \
+	    $$PWD/gameengine.h \
+	    $$PWD/gamejournal.h \
+	    $$PWD/gamestate.h \
+	    $$PWD/latencyhistogram.h \
+	    $$PWD/matchmaker.h \
+	    $$PWD/metrics.h \
+	    $$PWD/metricsendpoint.h \
+	    $$PWD/objectpool.h \
+	    $$PWD/outgoingframe.h \
+	    $$PWD/server.h \
+	    $$PWD/solvedtable.h \
+	    $$PWD/timerwheel.h
@@ -0,0 +1,22 @@
+#-------------------------------------------------
+#
+# Servidor dedicado sin interfaz gráfica
+#
+#-------------------------------------------------
+
+QT	+= core network
+QT	-= gui
+
+TARGET = GatoServer
+CONFIG	+= console
+CONFIG	-= app_bundle
+TEMPLATE = app
+
+include(../core.pri)
+
+SOURCES	+=  main.cpp \
+	    gameserver.cpp \
+	    gamesession.cpp
+
+HEADERS  += gameserver.h \
+	    gamesession.h
@@ -0,0 +1,210 @@
+#include "gameserver.h"
+#include "metrics.h"
+
+#include <QTextStream>
+
+GameServer::GameServer(quint16 port, QObject *parent)
+    : QObject(parent),
+      server(port),
+      connections(0)
+{
+    journal = 0;
+    moves = 0;
+    games = 0;
+    movesAtLastReport = 0;
+    baselineMemory = 0;
+
+    connect(&server, SIGNAL(newConnection(Connection*)),
+            this, SLOT(newConnection(Connection*)), Qt::DirectConnection);
+    connect(&reportTimer, SIGNAL(timeout()), this, SLOT(printReport()));
+}
+
+/*!
+ * Número de hilos para las conexiones; ver Server::setWorkerThreads().
+ */
+void GameServer::setWorkerThreads(int count)
+{
+    server.setWorkerThreads(count);
+}
+
+/*!
+ * Bitácora para las partidas que empiecen de aquí en adelante.
+ */
+void GameServer::setJournal(GameJournal *journal)
+{
+    this->journal = journal;
+}
+
+bool GameServer::isListening() const
+{
+    return server.isListening();
+}
+
+quint16 GameServer::serverPort() const
+{
+    return server.serverPort();
+}
+
+int GameServer::connectionCount() const
+{
+    return connections.fetchAndAddRelaxed(0);
+}
+
+int GameServer::sessionCount() const
+{
+    return sessions.size();
+}
+
+quint64 GameServer::movesRelayed() const
+{
+    return moves;
+}
+
+quint64 GameServer::gamesFinished() const
+{
+    return games;
+}
+
+/*!
+ * Imprime periódicamente las estadísticas del servidor en la salida estándar.
+ * La memoria residente de este momento, ya configurado y sin partidas, es la
+ * base contra la que se mide la memoria por partida.
+ */
+void GameServer::startReporting(int interval)
+{
+    if (sessions.isEmpty())
+        baselineMemory = Metrics::residentMemory();
+    reportClock.start();
+    reportTimer.start(interval);
+}
+
+/*!
+ * Conexiones, partidas, movimientos por segundo desde el último reporte y memoria
+ * por partida: lo que creció la memoria residente sobre la base en reposo,
+ * entre las partidas activas (incluye a los clientes que esperan oponente).
+ */
+void GameServer::printReport()
+{
+    const qint64 elapsed = reportClock.restart();
+    const double movesPerSecond = elapsed > 0
+            ? (moves - movesAtLastReport) * 1000.0 / elapsed : 0.0;
+    movesAtLastReport = moves;
+
+    const qint64 memory = Metrics::residentMemory();
+    QTextStream out(stdout);
+    out << "conexiones=" << connectionCount()
+        << " hilos=" << server.workerThreads()
+        << " partidas=" << sessions.size()
+        << " terminadas=" << games
+        << " movimientos/s=" << movesPerSecond
+        << " memoria=" << memory / 1024 << "KiB";
+    if (!sessions.isEmpty() && memory > 0)
+        out << " memoria/partida=" << qMax(Q_INT64_C(0), memory - baselineMemory) / sessions.size()
+            << "B";
+    out << endl;
+}
+
+/*!
+ * El cliente no recibe nuestro saludo hasta que tenga oponente, así no ve el
+ * tablero habilitado mientras espera.
+ * Corre en el hilo de la conexión, por eso solo toca el contador atómico y el
+ * conjunto de conexiones sin partida, y conecta señales; el resto del trabajo
+ * llega en cola al hilo principal. Solo se escucha disconnected(): un cierre
+ * remoto emite también error(), y se contaría dos veces.
+ */
+void GameServer::newConnection(Connection *connection)
+{
+    connections.ref();
+    connection->setGreetingDeferred(true);
+    {
+        QMutexLocker locker(&unmatchedMutex);
+        unmatched.insert(connection);
+    }
+
+    connect(connection, SIGNAL(readyForUse()), this, SLOT(readyForUse()));
+    connect(connection, SIGNAL(disconnected()), this, SLOT(connectionClosed()));
+}
+
+/*!
+ * Las señales llegan en cola desde el hilo de la conexión: cuando se atienden,
+ * la conexión pudo haberse cerrado y borrado, o ya pertenecer a una partida.
+ * Solo se compara el apuntador; si no está en el conjunto no se debe tocar.
+ */
+bool GameServer::isUnmatched(QObject *connection)
+{
+    QMutexLocker locker(&unmatchedMutex);
+    return unmatched.contains(connection);
+}
+
+/*!
+ * El cliente entra a la cola de espera; en cuanto hay dos se juega una partida.
+ */
+void GameServer::readyForUse()
+{
+    if (!isUnmatched(sender()))
+        return;
+    Connection *connection = qobject_cast<Connection *>(sender());
+    if (!connection)
+        return;
+
+    matchmaker.enqueue(connection);
+    while (matchmaker.waitingCount() >= 2) {
+        Connection *first = matchmaker.takeNext();
+        Connection *second = matchmaker.takeNext();
+
+        // A partir de aquí la partida se encarga de las conexiones; los
+        // cierres que ya estén en cola se ignoran al no estar en el conjunto
+        first->disconnect(this);
+        second->disconnect(this);
+        {
+            QMutexLocker locker(&unmatchedMutex);
+            unmatched.remove(first);
+            unmatched.remove(second);
+        }
+
+        quint32 sessionId = matchmaker.startSession(first, second);
+        GameSession *session = new GameSession(sessionId, first, second, this);
+        session->setJournal(journal);
+        connect(session, SIGNAL(moveRelayed()), this, SLOT(countMove()));
+        connect(session, SIGNAL(gameFinished()), this, SLOT(countGame()));
+        connect(session, SIGNAL(finished(GameSession*)),
+                this, SLOT(sessionFinished(GameSession*)));
+        sessions.insert(sessionId, session);
+    }
+}
+
+/*!
+ * Un cliente que aún no tenía partida se desconectó.
+ */
+void GameServer::connectionClosed()
+{
+    {
+        QMutexLocker locker(&unmatchedMutex);
+        if (!unmatched.remove(sender()))
+            return;
+    }
+    Connection *connection = static_cast<Connection *>(sender());
+
+    matchmaker.remove(connection);
+    connection->disconnect(this);
+    connection->deleteLater();
+    connections.deref();
+}
+
+void GameServer::sessionFinished(GameSession *session)
+{
+    sessions.remove(session->id());
+    matchmaker.endSession(session->id());
+    session->deleteLater();
+    connections.fetchAndAddRelaxed(-2);
+}
+
+void GameServer::countMove()
+{
+    ++moves;
+}
+
+void GameServer::countGame()
+{
+    ++games;
+}
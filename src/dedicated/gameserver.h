@@ -0,0 +1,70 @@
+#ifndef GAMESERVER_H
+#define GAMESERVER_H
+
+#include <QAtomicInt>
+#include <QElapsedTimer>
+#include <QObject>
+#include <QHash>
+#include <QMutex>
+#include <QSet>
+#include <QTimer>
+
+#include "connection.h"
+#include "gamejournal.h"
+#include "gamesession.h"
+#include "matchmaker.h"
+#include "server.h"
+
+/*
+ * Servidor dedicado: acepta clientes por TCP, los empareja en orden de llegada
+ * con el Matchmaker y crea una GameSession independiente para cada par.
+ */
+class GameServer : public QObject
+{
+    Q_OBJECT
+
+public:
+    GameServer(quint16 port, QObject *parent = 0);
+
+    void setWorkerThreads(int count);
+    void setJournal(GameJournal *journal);
+    bool isListening() const;
+    quint16 serverPort() const;
+    int connectionCount() const;
+    int sessionCount() const;
+    quint64 movesRelayed() const;
+    quint64 gamesFinished() const;
+
+    void startReporting(int interval);
+
+public slots:
+    void printReport();
+
+private slots:
+    void newConnection(Connection *connection);
+    void readyForUse();
+    void connectionClosed();
+    void sessionFinished(GameSession *session);
+    void countMove();
+    void countGame();
+
+private:
+    bool isUnmatched(QObject *connection);
+
+    Server server;
+    Matchmaker matchmaker;
+    QHash<quint32, GameSession *> sessions;
+    // Conexiones que aún no están en una partida; las agrega el hilo de cada conexión
+    QMutex unmatchedMutex;
+    QSet<QObject *> unmatched;
+    GameJournal *journal;
+    QAtomicInt connections;
+    quint64 moves;
+    quint64 games;
+    quint64 movesAtLastReport;
+    qint64 baselineMemory;  // memoria residente en reposo, antes de las partidas
+    QElapsedTimer reportClock;
+    QTimer reportTimer;
+};
+
+#endif
@@ -0,0 +1,136 @@
+#include "gamesession.h"
+#include "gamejournal.h"
+#include "metrics.h"
+#include "objectpool.h"
+
+/*!
+ * Empieza la partida: cada jugador recibe como saludo el nombre de su oponente,
+ * con lo que su interfaz habilita el tablero.
+ */
+GameSession::GameSession(quint32 id, Connection *first, Connection *second, QObject *parent)
+    : QObject(parent)
+{
+    sessionId = id;
+    players[0] = first;
+    players[1] = second;
+    isFinished = false;
+    journal = 0;
+    journalGame = 0;
+    journalMoves = 0;
+
+    first->setGreetingMessage(second->name());
+    second->setGreetingMessage(first->name());
+
+    for (int i = 0; i < 2; ++i) {
+        connect(players[i], SIGNAL(newGameState(GameState)),
+                players[1 - i], SLOT(sendGameState(GameState)));
+        connect(players[i], SIGNAL(newGameState(GameState)),
+                this, SLOT(trackGameState(GameState)));
+        connect(players[i], SIGNAL(disconnected()), this, SLOT(playerLeft()));
+        connect(players[i], SIGNAL(error(QAbstractSocket::SocketError)),
+                this, SLOT(playerLeft()));
+        QMetaObject::invokeMethod(players[i], "sendGreetingMessage", Qt::AutoConnection);
+    }
+}
+
+/*!
+ * Cierra las conexiones de ambos jugadores; para el que sigue conectado es
+ * equivalente a que su oponente se haya ido. Cada conexión se destruye en su
+ * propio hilo.
+ */
+GameSession::~GameSession()
+{
+    for (int i = 0; i < 2; ++i) {
+        players[i]->disconnect(this);
+        players[i]->disconnect(players[1 - i]);
+        players[i]->deleteLater();
+    }
+}
+
+/*!
+ * Igual que las conexiones, las partidas salen de un pool.
+ */
+void *GameSession::operator new(size_t size)
+{
+    return ObjectPool<GameSession>::allocate(size);
+}
+
+void GameSession::operator delete(void *pointer, size_t size)
+{
+    ObjectPool<GameSession>::release(pointer, size);
+}
+
+/*!
+ * Identificador que le asignó el Matchmaker.
+ */
+quint32 GameSession::id() const
+{
+    return sessionId;
+}
+
+/*!
+ * Bitácora donde se anotan las jugadas de la partida, o 0 para no anotarlas.
+ */
+void GameSession::setJournal(GameJournal *journal)
+{
+    this->journal = journal;
+}
+
+/*!
+ * Actualiza la copia local del tablero con el estado que un jugador le mandó al otro.
+ */
+void GameSession::trackGameState(const GameState &gameState)
+{
+    // El estado final de una partida repite el tablero de la última jugada,
+    // solo cuenta como movimiento si aparece una marca nueva
+    const int before = engine.moveCount();
+    const GameEngine::Result resultBefore = engine.result();
+    GameState previous(gameState.rows, gameState.columns, gameState.winLength);
+    if (journal && before > 0)
+        engine.store(&previous);
+    if (!engine.load(gameState))
+        return;
+    if (engine.moveCount() > before) {
+        if (before == 0) {
+            Metrics::add(Metrics::GamesStarted);
+            if (journal) {
+                journalGame = journal->startGame(engine.rows(), engine.columns(),
+                                                 engine.winLength());
+                journalMoves = 0;
+            }
+        }
+        int cell;
+        if (journalGame && engine.moveCount() == before + 1
+                && gameState.followsFrom(previous, &cell) && cell != GameDelta::NoCell)
+            journal->recordMove(journalGame, ++journalMoves, cell, gameState.cells.at(cell));
+        emit moveRelayed();
+    }
+
+    if (gameState.status != GameState::Playing) {
+        // La interfaz manda el estado final con el tablero ya vacío; entonces
+        // el resultado es el del tablero que había antes
+        if (journalGame) {
+            const GameEngine::Result result = engine.result();
+            journal->finishGame(journalGame, journalMoves,
+                                result != GameEngine::InProgress ? result : resultBefore);
+            journalGame = 0;
+        }
+        engine.reset();
+        Metrics::add(Metrics::GamesFinished);
+        emit gameFinished();
+    }
+}
+
+void GameSession::playerLeft()
+{
+    if (isFinished)
+        return;
+    isFinished = true;
+    if (engine.moveCount() > 0)
+        Metrics::add(Metrics::GamesAbandoned);
+    if (journalGame) {
+        journal->finishGame(journalGame, journalMoves, JournalRecord::Abandoned);
+        journalGame = 0;
+    }
+    emit finished(this);
+}
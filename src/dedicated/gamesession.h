@@ -0,0 +1,50 @@
+#ifndef GAMESESSION_H
+#define GAMESESSION_H
+
+#include <QObject>
+
+#include "connection.h"
+#include "gameengine.h"
+
+class GameJournal;
+
+/*
+ * Una partida entre dos clientes conectados al servidor dedicado. El estado del
+ * juego pasa directamente de la conexión de un jugador a la del otro (entre sus
+ * hilos si están en hilos distintos); la partida solo lleva su propia copia del
+ * tablero en el hilo principal.
+ */
+class GameSession : public QObject
+{
+    Q_OBJECT
+
+public:
+    GameSession(quint32 id, Connection *first, Connection *second, QObject *parent = 0);
+    ~GameSession();
+
+    static void *operator new(size_t size);
+    static void operator delete(void *pointer, size_t size);
+
+    quint32 id() const;
+    void setJournal(GameJournal *journal);
+
+signals:
+    void moveRelayed();
+    void gameFinished();
+    void finished(GameSession *session);
+
+private slots:
+    void trackGameState(const GameState &gameState);
+    void playerLeft();
+
+private:
+    quint32 sessionId;
+    Connection *players[2];
+    GameEngine engine;
+    bool isFinished;
+    GameJournal *journal;
+    quint32 journalGame;
+    int journalMoves;
+};
+
+#endif
@@ -0,0 +1,73 @@
+#include <QCoreApplication>
+#include <QElapsedTimer>
+#include <QStringList>
+#include <QTextStream>
+#include <QThread>
+
+#include "gamejournal.h"
+#include "gameserver.h"
+#include "metricsendpoint.h"
+
+#ifdef Q_OS_UNIX
+#include <sys/resource.h>
+#endif
+
+static const quint16 DefaultPort = 45001;
+static const int ReportInterval = 10 * 1000;
+
+/*!
+ * Sube el límite de descriptores de archivo al máximo permitido, cada cliente ocupa uno.
+ */
+static void raiseFileLimit()
+{
+#ifdef Q_OS_UNIX
+    struct rlimit limit;
+    if (getrlimit(RLIMIT_NOFILE, &limit) == 0 && limit.rlim_cur < limit.rlim_max) {
+        limit.rlim_cur = limit.rlim_max;
+        setrlimit(RLIMIT_NOFILE, &limit);
+    }
+#endif
+}
+
+/*
+ * Uso: GatoServer [puerto] [segundos entre reportes] [hilos]
+ * Las métricas se publican con GATO_METRICS_PORT y/o GATO_METRICS_FILE, ver MetricsEndpoint.
+ * Con GATO_JOURNAL=directorio las partidas se anotan en una bitácora, ver GameJournal.
+ */
+int main(int argc, char *argv[])
+{
+    QElapsedTimer startup;
+    startup.start();
+
+    QCoreApplication a(argc, argv);
+    raiseFileLimit();
+
+    QStringList args = a.arguments();
+    quint16 port = args.size() > 1 ? args.at(1).toUShort() : DefaultPort;
+    int interval = args.size() > 2 ? args.at(2).toInt() * 1000 : ReportInterval;
+    int threads = args.size() > 3 ? args.at(3).toInt() : QThread::idealThreadCount();
+
+    QTextStream out(stdout);
+    GameServer server(port);
+    if (!server.isListening()) {
+        out << "No se pudo escuchar en el puerto " << port << endl;
+        return 1;
+    }
+
+    server.setWorkerThreads(threads);
+    GameJournal *journal = GameJournal::fromEnvironment(&a);
+    server.setJournal(journal);
+    out << "Servidor escuchando en el puerto " << server.serverPort()
+        << " con " << threads << " hilos (arranque en " << startup.elapsed() << " ms)" << endl;
+    if (interval > 0)
+        server.startReporting(interval);
+
+    MetricsEndpoint *metrics = MetricsEndpoint::fromEnvironment(&a);
+    if (metrics && metrics->isListening())
+        out << "Métricas en http://127.0.0.1:" << metrics->serverPort() << "/metrics" << endl;
+
+    if (journal)
+        out << "Bitácora de partidas en " << journal->directory() << endl;
+
+    return a.exec();
+}
@@ -0,0 +1,120 @@
+#include "discoveryschedule.h"
+
+DiscoverySchedule::DiscoverySchedule(quint32 id)
+{
+    instanceId = id;
+    seeking = true;
+    currentInterval = MinInterval;
+    heardSeeking = 0;
+    heardLowerId = false;
+}
+
+quint32 DiscoverySchedule::id() const
+{
+    return instanceId;
+}
+
+/*!
+ * Indica si nosotros iniciamos la conexión con el nodo otherId cuando ambos buscamos partida.
+ */
+bool DiscoverySchedule::dialsFirst(quint32 otherId) const
+{
+    return instanceId < otherId;
+}
+
+bool DiscoverySchedule::isSeeking() const
+{
+    return seeking;
+}
+
+/*!
+ * Cambia el estado que anunciamos. Regresa true si cambió, y entonces hay que
+ * anunciarlo de inmediato (reset()).
+ */
+bool DiscoverySchedule::setSeeking(bool seeking)
+{
+    if (this->seeking == seeking)
+        return false;
+    this->seeking = seeking;
+    return true;
+}
+
+int DiscoverySchedule::interval() const
+{
+    return currentInterval;
+}
+
+/*!
+ * Vuelve al intervalo mínimo; quien lo llama anuncia en ese momento.
+ */
+void DiscoverySchedule::reset()
+{
+    currentInterval = MinInterval;
+    heardSeeking = 0;
+    heardLowerId = false;
+}
+
+/*!
+ * Fin de un intervalo: regresa si hay que anunciarse y duplica el intervalo.
+ */
+bool DiscoverySchedule::endInterval()
+{
+    const bool announce = heardSeeking < SuppressionThreshold || heardLowerId;
+    heardSeeking = 0;
+    heardLowerId = false;
+    currentInterval = qMin(currentInterval * 2, int(MaxInterval));
+    return announce;
+}
+
+/*!
+ * Registra el anuncio número sequence del nodo senderId. El mismo anuncio llega
+ * repetido si se mandó por varias interfaces, y el nuestro también nos llega;
+ * esos se ignoran. Regresa una combinación de Reaction.
+ */
+int DiscoverySchedule::heard(quint32 senderId, quint32 sequence, bool senderSeeking, qint64 now)
+{
+    if (senderId == instanceId)
+        return Ignore;
+
+    QHash<quint32, Announcement>::iterator last = lastById.find(senderId);
+    const bool isNewNode = last == lastById.end();
+    if (!isNewNode && last->sequence == sequence)
+        return Ignore;
+    Announcement announcement;
+    announcement.sequence = sequence;
+    announcement.lastSeen = now;
+    lastById.insert(senderId, announcement);
+
+    if (!senderSeeking)
+        return Ignore;
+    ++heardSeeking;
+    if (!dialsFirst(senderId))
+        heardLowerId = true;
+
+    int reaction = Ignore;
+    // Un nodo nuevo buscando partida: anunciarnos pronto para que nos vea
+    if (isNewNode && seeking && currentInterval > MinInterval)
+        reaction |= AnnounceNow;
+    if (dialsFirst(senderId))
+        reaction |= Dial;
+    return reaction;
+}
+
+/*!
+ * Olvida los nodos que no se han anunciado en Ttl ms.
+ */
+void DiscoverySchedule::expire(qint64 now)
+{
+    QHash<quint32, Announcement>::iterator it = lastById.begin();
+    while (it != lastById.end()) {
+        if (now - it->lastSeen > Ttl)
+            it = lastById.erase(it);
+        else
+            ++it;
+    }
+}
+
+int DiscoverySchedule::knownNodes() const
+{
+    return lastById.size();
+}
@@ -0,0 +1,57 @@
+#ifndef DISCOVERYSCHEDULE_H
+#define DISCOVERYSCHEDULE_H
+
+#include <QHash>
+
+/*
+ * Reglas de los anuncios de PeerManager, sin sockets ni temporizadores para
+ * poder simularlas con muchos nodos. El intervalo entre anuncios empieza en
+ * MinInterval y se duplica hasta MaxInterval mientras nada cambie. De dos nodos
+ * que se buscan, el de identificador menor es el que se conecta; por eso un
+ * nodo solo puede callar si en el intervalo escuchó suficientes nodos buscando
+ * partida y todos tienen identificador mayor: a esos los llama él, y nadie
+ * tiene que llamarlo a él. Si alguno tiene identificador menor, ese necesita
+ * nuestro anuncio para llamarnos.
+ */
+class DiscoverySchedule
+{
+public:
+    static const int MinInterval = 1000;
+    static const int MaxInterval = 32000;
+    static const int SuppressionThreshold = 3;
+    static const int Ttl = 120 * 1000;      // ms que se recuerda a un nodo sin anuncios
+
+    /* Qué hacer con un anuncio, se pueden combinar */
+    enum Reaction { Ignore = 0, Dial = 1, AnnounceNow = 2 };
+
+    explicit DiscoverySchedule(quint32 id);
+
+    quint32 id() const;
+    bool dialsFirst(quint32 otherId) const;
+
+    bool isSeeking() const;
+    bool setSeeking(bool seeking);
+
+    int interval() const;
+    void reset();
+    bool endInterval();
+
+    int heard(quint32 senderId, quint32 sequence, bool senderSeeking, qint64 now);
+    void expire(qint64 now);
+    int knownNodes() const;
+
+private:
+    struct Announcement {
+        quint32 sequence;
+        qint64 lastSeen;
+    };
+
+    quint32 instanceId;
+    bool seeking;
+    int currentInterval;
+    int heardSeeking;
+    bool heardLowerId;
+    QHash<quint32, Announcement> lastById;
+};
+
+#endif
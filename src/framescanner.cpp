@@ -0,0 +1,230 @@
+#include "framescanner.h"
+
+#include <string.h>
+
+static const char SeparatorToken = ' ';
+static const int MaxTypeLength = 8;    // "GREETING"
+static const int MaxLengthDigits = 7;  // MaxBufferSize tiene 7 dígitos
+
+FrameScanner::FrameScanner()
+{
+    offset = 0;
+    binary = false;
+}
+
+/*!
+  Compone una trama del protocolo de texto, ej. 'MESSAGE 5 hola'.
+ */
+QByteArray FrameScanner::textFrame(DataType type, const QByteArray &payload)
+{
+    QByteArray data;
+    switch (type) {
+    case PlainText:
+    case PackedState:
+        data = "MESSAGE ";
+        break;
+    case Ping:
+        data = "PING ";
+        break;
+    case Pong:
+        data = "PONG ";
+        break;
+    case Greeting:
+        data = "GREETING ";
+        break;
+    default:
+        return QByteArray();
+    }
+    data += QByteArray::number(payload.size());
+    data += SeparatorToken;
+    data += payload;
+    return data;
+}
+
+/*!
+  Compone la cabecera de una trama del protocolo binario. Los enteros van en orden
+  de red (big-endian). Regresa un arreglo vacío si el tipo o la longitud no son válidos.
+ */
+QByteArray FrameScanner::binaryHeader(DataType type, quint32 sequence, int length)
+{
+    if (type == Greeting || type == Undefined || length < 0 || length > MaxBinaryPayload)
+        return QByteArray();
+
+    QByteArray header(BinaryHeaderSize, 0);
+    header[0] = char(type + 1);
+    header[2] = char(length >> 8);
+    header[3] = char(length);
+    header[4] = char(sequence >> 24);
+    header[5] = char(sequence >> 16);
+    header[6] = char(sequence >> 8);
+    header[7] = char(sequence);
+    return header;
+}
+
+/*!
+  Compone una trama completa del protocolo binario.
+ */
+QByteArray FrameScanner::binaryFrame(DataType type, quint32 sequence, const QByteArray &payload)
+{
+    QByteArray data = binaryHeader(type, sequence, payload.size());
+    if (data.isEmpty())
+        return data;
+    data += payload;
+    return data;
+}
+
+/*!
+  Cambia al protocolo binario; se llama justo después de procesar el saludo, ya que
+  todo lo que el otro nodo manda después del saludo usa el protocolo negociado.
+ */
+void FrameScanner::setBinaryFraming(bool enabled)
+{
+    binary = enabled;
+}
+
+bool FrameScanner::binaryFraming() const
+{
+    return binary;
+}
+
+/*!
+  Agrega los bytes leídos del socket. Antes de agregar se descartan los bytes
+  de las tramas ya procesadas, así el buffer solo crece con la cola pendiente.
+ */
+void FrameScanner::append(const QByteArray &data)
+{
+    if (offset > 0) {
+        buffer.remove(0, offset);
+        offset = 0;
+    }
+    buffer.append(data);
+}
+
+/*!
+  Extrae la siguiente trama completa del buffer. Regresa NeedMoreData si solo
+  hay una trama parcial (que se conserva intacta) e InvalidData si los bytes no
+  siguen el protocolo.
+ */
+FrameScanner::Result FrameScanner::next(DataType *type, QByteArray *payload, quint32 *sequence)
+{
+    if (binary)
+        return nextBinary(type, payload, sequence);
+
+    const char *data = buffer.constData() + offset;
+    const int available = buffer.size() - offset;
+    if (available <= 0)
+        return NeedMoreData;
+
+    // Tipo del mensaje, ej. 'MESSAGE '
+    const char *typeEnd = static_cast<const char *>(
+                memchr(data, SeparatorToken, qMin(available, MaxTypeLength + 1)));
+    if (!typeEnd)
+        return available > MaxTypeLength ? InvalidData : NeedMoreData;
+
+    const int typeLength = typeEnd - data;
+    DataType frameType = Undefined;
+    if (typeLength == 4 && memcmp(data, "PING", 4) == 0)
+        frameType = Ping;
+    else if (typeLength == 4 && memcmp(data, "PONG", 4) == 0)
+        frameType = Pong;
+    else if (typeLength == 7 && memcmp(data, "MESSAGE", 7) == 0)
+        frameType = PlainText;
+    else if (typeLength == 8 && memcmp(data, "GREETING", 8) == 0)
+        frameType = Greeting;
+    else
+        return InvalidData;
+
+    // Número de bytes del mensaje, ej. '5 '
+    int pos = typeLength + 1;
+    int length = 0;
+    int digits = 0;
+    for (;;) {
+        if (pos >= available)
+            return digits > MaxLengthDigits ? InvalidData : NeedMoreData;
+        const char c = data[pos++];
+        if (c == SeparatorToken)
+            break;
+        if (c < '0' || c > '9' || ++digits > MaxLengthDigits)
+            return InvalidData;
+        length = length * 10 + (c - '0');
+    }
+    if (digits == 0 || length > MaxBufferSize)
+        return InvalidData;
+
+    // Los datos en sí
+    if (available - pos < length)
+        return NeedMoreData;
+
+    *type = frameType;
+    *payload = buffer.mid(offset + pos, length);
+    if (sequence)
+        *sequence = 0;
+    offset += pos + length;
+    if (offset == buffer.size()) {
+        buffer.resize(0);
+        offset = 0;
+    }
+    return FrameReady;
+}
+
+FrameScanner::Result FrameScanner::nextBinary(DataType *type, QByteArray *payload,
+                                              quint32 *sequence)
+{
+    const uchar *data = reinterpret_cast<const uchar *>(buffer.constData()) + offset;
+    const int available = buffer.size() - offset;
+    if (available < BinaryHeaderSize)
+        return NeedMoreData;
+
+    if (data[0] < PlainText + 1 || data[0] >= Undefined + 1 || data[0] == Greeting + 1
+            || data[1] != 0)
+        return InvalidData;
+
+    const int length = (int(data[2]) << 8) | data[3];
+    if (available - BinaryHeaderSize < length)
+        return NeedMoreData;
+
+    *type = DataType(data[0] - 1);
+    *payload = buffer.mid(offset + BinaryHeaderSize, length);
+    if (sequence)
+        *sequence = (quint32(data[4]) << 24) | (quint32(data[5]) << 16)
+                    | (quint32(data[6]) << 8) | quint32(data[7]);
+    offset += BinaryHeaderSize + length;
+    if (offset == buffer.size()) {
+        buffer.resize(0);
+        offset = 0;
+    }
+    return FrameReady;
+}
+
+/*!
+  Número de bytes recibidos que aún no forman una trama completa.
+ */
+int FrameScanner::pendingBytes() const
+{
+    return buffer.size() - offset;
+}
+
+bool FrameScanner::isEmpty() const
+{
+    return pendingBytes() == 0;
+}
+
+/*!
+  Conserva solo la trama a medias, sin los bytes ya procesados que venían en la
+  misma lectura. Así una conexión ociosa con datos pendientes no retiene el
+  buffer completo de la última lectura.
+ */
+void FrameScanner::squeeze()
+{
+    if (offset > 0) {
+        buffer = buffer.mid(offset);
+        offset = 0;
+    }
+    buffer.squeeze();
+}
+
+void FrameScanner::clear()
+{
+    buffer.clear();
+    offset = 0;
+}
@@ -0,0 +1,63 @@
+#ifndef FRAMESCANNER_H
+#define FRAMESCANNER_H
+
+#include <QByteArray>
+
+static const int MaxBufferSize = 1024000;
+
+/*
+ * Analizador incremental de tramas con formato 'TIPO LONGITUD DATOS'.
+ * Acumula los bytes recibidos y extrae en una sola pasada todas las tramas
+ * completas, conservando la cola incompleta para la siguiente lectura.
+ * Con el protocolo binario (versión 2) cada trama lleva en cambio una cabecera
+ * fija de 8 bytes: tipo, banderas, longitud (16 bits) y número de secuencia (32 bits).
+ */
+class FrameScanner
+{
+public:
+    enum DataType {
+        PlainText,
+        Ping,
+        Pong,
+        Greeting,
+        PackedState,
+        MoveDelta,
+        ResyncRequest,
+        SessionToken,
+        Undefined
+    };
+    enum Result {
+        FrameReady,
+        NeedMoreData,
+        InvalidData
+    };
+
+    static const int BinaryHeaderSize = 8;
+    static const int MaxBinaryPayload = 0xffff;
+    // La trama válida más grande: 'GREETING 1024000 ' y MaxBufferSize bytes de datos
+    static const int MaxFrameSize = MaxBufferSize + 8 + 7 + 2;
+
+    FrameScanner();
+
+    static QByteArray textFrame(DataType type, const QByteArray &payload);
+    static QByteArray binaryHeader(DataType type, quint32 sequence, int length);
+    static QByteArray binaryFrame(DataType type, quint32 sequence, const QByteArray &payload);
+
+    void setBinaryFraming(bool enabled);
+    bool binaryFraming() const;
+    void append(const QByteArray &data);
+    Result next(DataType *type, QByteArray *payload, quint32 *sequence = 0);
+    int pendingBytes() const;
+    bool isEmpty() const;
+    void squeeze();
+    void clear();
+
+private:
+    Result nextBinary(DataType *type, QByteArray *payload, quint32 *sequence);
+
+    QByteArray buffer;
+    int offset;
+    bool binary;
+};
+
+#endif
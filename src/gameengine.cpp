@@ -0,0 +1,348 @@
+#include "gameengine.h"
+#include "solvedtable.h"
+
+/* Bits vacíos al inicio y al final de cada tablero, para leer ventanas sin salirse */
+static const int GuardBits = 64;
+
+/* Avance en filas y columnas de cada dirección */
+static const int DirectionStep[4][2] = { { 0, 1 }, { 1, 0 }, { 1, 1 }, { 1, -1 } };
+
+GameEngine::GameEngine(int rows, int columns, int winLength)
+{
+    rowCount = 0;
+    columnCount = 0;
+    lineLength = 0;
+    if (!setSize(rows, columns, winLength))
+        setSize(3, 3, 3);
+}
+
+/*!
+ * Cambia las dimensiones y deja el tablero vacío. Regresa false si no son válidas.
+ */
+bool GameEngine::setSize(int rows, int columns, int winLength)
+{
+    if (rows <= 0 || rows > GameState::MaxSide || columns <= 0 || columns > GameState::MaxSide
+            || winLength <= 0 || winLength > MaxWinLength || winLength > qMax(rows, columns))
+        return false;
+
+    rowCount = rows;
+    columnCount = columns;
+    lineLength = winLength;
+
+    // Cada línea de cada dirección ocupa bits seguidos, empezando desde la
+    // casilla que no tiene anterior en esa dirección, más un bit de separación
+    const int cells = rows * columns;
+    for (int d = 0; d < DirectionCount; ++d) {
+        const int dr = DirectionStep[d][0];
+        const int dc = DirectionStep[d][1];
+        bitIndex[d].resize(cells);
+        int next = GuardBits;
+        for (int r = 0; r < rows; ++r) {
+            for (int c = 0; c < columns; ++c) {
+                const int pr = r - dr, pc = c - dc;
+                if (pr >= 0 && pr < rows && pc >= 0 && pc < columns)
+                    continue;
+                for (int lr = r, lc = c; lr < rows && lc >= 0 && lc < columns; lr += dr, lc += dc)
+                    bitIndex[d][lr * columns + lc] = next++;
+                ++next;
+            }
+        }
+        const int words = (next + GuardBits + 63) / 64;
+        for (int side = 0; side < 2; ++side)
+            bits[side][d].resize(words);
+    }
+    board.resize(cells);
+    reset();
+    return true;
+}
+
+int GameEngine::rows() const
+{
+    return rowCount;
+}
+
+int GameEngine::columns() const
+{
+    return columnCount;
+}
+
+int GameEngine::winLength() const
+{
+    return lineLength;
+}
+
+int GameEngine::cellCount() const
+{
+    return board.size();
+}
+
+bool GameEngine::isClassic() const
+{
+    return rowCount == 3 && columnCount == 3 && lineLength == 3;
+}
+
+/*!
+ * Deja el tablero vacío.
+ */
+void GameEngine::reset()
+{
+    for (int side = 0; side < 2; ++side) {
+        for (int d = 0; d < DirectionCount; ++d)
+            bits[side][d].fill(0);
+    }
+    board.fill(GameState::Empty);
+    count = 0;
+    winnerKnown = true;
+    winner = -1;
+    winStart = 0;
+    winStep = 0;
+    winMove = -1;
+    winCount = 0;
+}
+
+/*!
+ * Marca la casilla si está libre y revisa solo las líneas que pasan por ella.
+ * Regresa false si el movimiento no es válido.
+ */
+bool GameEngine::play(int pos, GameState::Mark mark)
+{
+    if (mark == GameState::Empty || !canPlayAt(pos))
+        return false;
+
+    if (!winnerKnown)
+        findWinner();
+
+    board[pos] = quint8(mark);
+    ++count;
+    for (int d = 0; d < DirectionCount; ++d) {
+        const int bit = bitIndex[d].at(pos);
+        bits[mark][d][bit >> 6] |= Q_UINT64_C(1) << (bit & 63);
+    }
+
+    if (winner == -1) {
+        for (int d = 0; d < DirectionCount; ++d) {
+            if (completesLine(pos, mark, Direction(d), &winStart)) {
+                winner = mark;
+                winStep = DirectionStep[d][0] * columnCount + DirectionStep[d][1];
+                winMove = pos;
+                winCount = count;
+                break;
+            }
+        }
+    } else {
+        winCount = -1;
+    }
+    return true;
+}
+
+/*!
+ * Deshace la última jugada hecha en la casilla, para explorar jugadas sin copiar el tablero.
+ */
+void GameEngine::undo(int pos)
+{
+    if (pos < 0 || pos >= board.size() || board.at(pos) == GameState::Empty)
+        return;
+
+    const int mark = board.at(pos);
+    board[pos] = GameState::Empty;
+    --count;
+    for (int d = 0; d < DirectionCount; ++d) {
+        const int bit = bitIndex[d].at(pos);
+        bits[mark][d][bit >> 6] &= ~(Q_UINT64_C(1) << (bit & 63));
+    }
+    // Si se jugó algo después de la victoria play() ya no buscó líneas: puede
+    // haber otra y hay que revisar todo al pedir el resultado
+    if (winner != -1 && winMove == pos) {
+        winner = -1;
+        if (winCount != count + 1)
+            winnerKnown = false;
+    } else if (winner == mark)
+        winnerKnown = false;
+}
+
+/*!
+ * Asigna el contenido de una casilla sin validar, para cargar un tablero recibido por la red.
+ */
+void GameEngine::setCell(int pos, GameState::Mark mark)
+{
+    if (pos < 0 || pos >= board.size() || board.at(pos) == mark)
+        return;
+
+    const int old = board.at(pos);
+    if (old != GameState::Empty) {
+        --count;
+        for (int d = 0; d < DirectionCount; ++d) {
+            const int bit = bitIndex[d].at(pos);
+            bits[old][d][bit >> 6] &= ~(Q_UINT64_C(1) << (bit & 63));
+        }
+    }
+    board[pos] = quint8(mark);
+    if (mark != GameState::Empty) {
+        ++count;
+        for (int d = 0; d < DirectionCount; ++d) {
+            const int bit = bitIndex[d].at(pos);
+            bits[mark][d][bit >> 6] |= Q_UINT64_C(1) << (bit & 63);
+        }
+    }
+    winnerKnown = false;
+}
+
+/*!
+ * Carga un tablero recibido por la red, cambiando las dimensiones si hace falta.
+ */
+bool GameEngine::load(const GameState &state)
+{
+    if ((state.rows != rowCount || state.columns != columnCount || state.winLength != lineLength)
+            && !setSize(state.rows, state.columns, state.winLength))
+        return false;
+    if (state.cells.size() != board.size())
+        return false;
+
+    for (int i = 0; i < board.size(); ++i)
+        setCell(i, state.cells.at(i));
+    return true;
+}
+
+/*!
+ * Copia las dimensiones y las casillas al estado que se manda por la red.
+ */
+void GameEngine::store(GameState *state) const
+{
+    state->rows = rowCount;
+    state->columns = columnCount;
+    state->winLength = lineLength;
+    state->cells.resize(board.size());
+    for (int i = 0; i < board.size(); ++i)
+        state->cells[i] = GameState::Mark(board.at(i));
+}
+
+int GameEngine::moveCount() const
+{
+    return count;
+}
+
+bool GameEngine::isFull() const
+{
+    return count == board.size();
+}
+
+/*!
+ * Regresa las casillas de la línea ganadora, o una lista vacía si nadie ha ganado.
+ */
+QList<int> GameEngine::winningLine() const
+{
+    if (!winnerKnown)
+        findWinner();
+
+    QList<int> line;
+    if (winner != -1) {
+        for (int i = 0; i < lineLength; ++i)
+            line.append(winStart + i * winStep);
+    }
+    return line;
+}
+
+GameEngine::Result GameEngine::result() const
+{
+    if (!winnerKnown)
+        findWinner();
+
+    if (winner == GameState::Cross)
+        return CrossWon;
+    if (winner == GameState::Circle)
+        return CircleWon;
+    return isFull() ? Draw : InProgress;
+}
+
+/*!
+ * Máscara de 9 bits con las marcas del jugador en el tablero de 3x3 (bit i = casilla i),
+ * el índice que usa la tabla resuelta.
+ */
+quint16 GameEngine::classicMarks(GameState::Mark mark) const
+{
+    quint16 marks = 0;
+    for (int i = 0; i < board.size() && i < BOARDSIZE; ++i) {
+        if (board.at(i) == mark)
+            marks |= quint16(1 << i);
+    }
+    return marks;
+}
+
+/*!
+ * Revisa si la casilla forma parte de winLength marcas seguidas del jugador en
+ * la dirección dada. Se toma la ventana de 2*winLength-1 bits centrada en la
+ * casilla; tras ~log2(winLength) pasos de 'm &= m >> s' el bit j queda encendido
+ * solo si los bits j..j+winLength-1 lo estaban. Los bits de separación entre
+ * líneas son 0, así que una racha nunca se sale de su línea.
+ */
+bool GameEngine::completesLine(int pos, int side, Direction direction, int *start) const
+{
+    const QVector<quint64> &words = bits[side][direction];
+    const int first = bitIndex[direction].at(pos) - (lineLength - 1);
+    const int word = first >> 6;
+    const int shift = first & 63;
+    quint64 window = words.at(word) >> shift;
+    if (shift)
+        window |= words.at(word + 1) << (64 - shift);
+    window &= (Q_UINT64_C(1) << (2 * lineLength - 1)) - 1;
+
+    quint64 runs = window;
+    for (int length = 1; length < lineLength;) {
+        const int step = qMin(length, lineLength - length);
+        runs &= runs >> step;
+        length += step;
+    }
+    runs &= (Q_UINT64_C(1) << lineLength) - 1;
+    if (!runs)
+        return false;
+
+    int offset = 0;
+    while (!(runs & (Q_UINT64_C(1) << offset)))
+        ++offset;
+    const int stepCells = DirectionStep[direction][0] * columnCount + DirectionStep[direction][1];
+    *start = pos + (offset - (lineLength - 1)) * stepCells;
+    return true;
+}
+
+/*!
+ * Busca un ganador en todo el tablero después de cargarlo casilla por casilla.
+ * En el tablero de 3x3 basta con leer la tabla resuelta si la posición es alcanzable.
+ */
+void GameEngine::findWinner() const
+{
+    winnerKnown = true;
+    winner = -1;
+    winMove = -1;
+
+    if (isClassic()) {
+        const quint16 cross = classicMarks(GameState::Cross);
+        const int index = SolvedTable::index(cross, classicMarks(GameState::Circle));
+        if (SolvedTable::isValid(index)) {
+            const quint16 line = SolvedTable::winningLine(index);
+            if (line) {
+                winner = (cross & line) == line ? GameState::Cross : GameState::Circle;
+                winStart = 0;
+                while (!(line & (1 << winStart)))
+                    ++winStart;
+                int second = winStart + 1;
+                while (!(line & (1 << second)))
+                    ++second;
+                winStep = second - winStart;
+            }
+            return;
+        }
+    }
+
+    for (int pos = 0; pos < board.size(); ++pos) {
+        const int side = board.at(pos);
+        if (side == GameState::Empty)
+            continue;
+        for (int d = 0; d < DirectionCount; ++d) {
+            if (completesLine(pos, side, Direction(d), &winStart)) {
+                winner = side;
+                winStep = DirectionStep[d][0] * columnCount + DirectionStep[d][1];
+                return;
+            }
+        }
+    }
+}
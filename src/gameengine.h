@@ -0,0 +1,91 @@
+#ifndef GAMEENGINE_H
+#define GAMEENGINE_H
+
+#include <QList>
+#include <QVector>
+#include "gamestate.h"
+
+/*
+ * Motor del juego sin interfaz gráfica para tableros de filas x columnas donde
+ * gana quien junta winLength marcas seguidas (el gato es 3x3x3, el gomoku 15x15x5).
+ * Las marcas de cada jugador se guardan en cuatro tableros de bits, uno por
+ * dirección (filas, columnas y las dos diagonales), donde cada línea ocupa bits
+ * consecutivos separados por un bit vacío. Así la línea que pasa por una casilla
+ * es una ventana de bits de una o dos palabras, y al jugar solo se revisan esas
+ * cuatro ventanas con desplazamientos y AND: el costo no crece con el tablero.
+ */
+class GameEngine
+{
+public:
+    enum Result { InProgress, CrossWon, CircleWon, Draw };
+
+    static const int MaxWinLength = 32;
+
+    GameEngine(int rows = 3, int columns = 3, int winLength = 3);
+
+    bool setSize(int rows, int columns, int winLength);
+    int rows() const;
+    int columns() const;
+    int winLength() const;
+    int cellCount() const;
+    bool isClassic() const;
+
+    void reset();
+    bool canPlayAt(int pos) const;
+    bool play(int pos, GameState::Mark mark);
+    void undo(int pos);
+    void setCell(int pos, GameState::Mark mark);
+    bool load(const GameState &state);
+    void store(GameState *state) const;
+    GameState::Mark at(int pos) const;
+    int moveCount() const;
+    bool isFull() const;
+    QList<int> winningLine() const;
+    Result result() const;
+
+    quint16 classicMarks(GameState::Mark mark) const;
+
+    static int popCount(quint16 bits);
+
+private:
+    enum Direction { Horizontal, Vertical, Diagonal, AntiDiagonal, DirectionCount };
+
+    bool completesLine(int pos, int side, Direction direction, int *start) const;
+    void findWinner() const;
+
+    int rowCount;
+    int columnCount;
+    int lineLength;
+    QVector<int> bitIndex[DirectionCount]; // casilla -> bit en el tablero de cada dirección
+    QVector<quint64> bits[2][DirectionCount]; // Cross, Circle
+    QVector<quint8> board;
+    int count;
+
+    // La línea ganadora se calcula al jugar; setCell() la deja pendiente
+    mutable bool winnerKnown;
+    mutable int winner;     // -1 nadie, o el índice del jugador
+    mutable int winStart;
+    mutable int winStep;
+    mutable int winMove;    // jugada que completó la línea, -1 si se encontró al cargar
+    int winCount;           // jugadas en el tablero al completarla, -1 si se jugó después
+};
+
+inline bool GameEngine::canPlayAt(int pos) const
+{
+    return pos >= 0 && pos < board.size() && board.at(pos) == GameState::Empty;
+}
+
+inline GameState::Mark GameEngine::at(int pos) const
+{
+    return GameState::Mark(board.at(pos));
+}
+
+inline int GameEngine::popCount(quint16 bits)
+{
+    int count = 0;
+    for (; bits; bits &= bits - 1)
+        ++count;
+    return count;
+}
+
+#endif
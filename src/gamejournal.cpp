@@ -0,0 +1,633 @@
+#include "gamejournal.h"
+#include "metrics.h"
+#include "solvedtable.h"
+
+#include <QDateTime>
+#include <QDir>
+#include <QFileInfo>
+#include <QHash>
+#include <QMutexLocker>
+
+#include <string.h>
+
+#ifdef Q_OS_UNIX
+#include <unistd.h>
+#endif
+
+static const char Magic[] = "GATOJRNL";
+static const int MagicSize = 8;
+static const int HeaderSize = 16;   // magic, versión y tamaño de registro
+static const quint32 FormatVersion = 1;
+static const int ChecksumOffset = 20;
+
+static void writeUInt16(char *data, quint16 value)
+{
+    data[0] = char(value);
+    data[1] = char(value >> 8);
+}
+
+static void writeUInt32(char *data, quint32 value)
+{
+    for (int i = 0; i < 4; ++i)
+        data[i] = char(value >> (8 * i));
+}
+
+static quint16 readUInt16(const char *data)
+{
+    const uchar *bytes = reinterpret_cast<const uchar *>(data);
+    return quint16(bytes[0] | (bytes[1] << 8));
+}
+
+static quint32 readUInt32(const char *data)
+{
+    const uchar *bytes = reinterpret_cast<const uchar *>(data);
+    return quint32(bytes[0]) | (quint32(bytes[1]) << 8) | (quint32(bytes[2]) << 16)
+            | (quint32(bytes[3]) << 24);
+}
+
+/*
+ * FNV-1a de 32 bits; detecta registros a medias o alterados.
+ */
+static quint32 checksum(const char *data, int size)
+{
+    quint32 hash = 2166136261u;
+    for (int i = 0; i < size; ++i) {
+        hash ^= uchar(data[i]);
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+JournalRecord::JournalRecord()
+{
+    game = 0;
+    sequence = 0;
+    timestamp = 0;
+    cell = 0;
+    value = 0;
+    kind = Move;
+}
+
+void JournalRecord::encode(char *data) const
+{
+    writeUInt32(data, game);
+    writeUInt32(data + 4, sequence);
+    writeUInt32(data + 8, quint32(quint64(timestamp)));
+    writeUInt32(data + 12, quint32(quint64(timestamp) >> 32));
+    writeUInt16(data + 16, cell);
+    data[18] = char(value);
+    data[19] = char(kind);
+    writeUInt32(data + ChecksumOffset, checksum(data, ChecksumOffset));
+}
+
+bool JournalRecord::decode(const char *data, JournalRecord *record)
+{
+    if (readUInt32(data + ChecksumOffset) != checksum(data, ChecksumOffset))
+        return false;
+
+    record->game = readUInt32(data);
+    record->sequence = readUInt32(data + 4);
+    record->timestamp = qint64(quint64(readUInt32(data + 8))
+                               | (quint64(readUInt32(data + 12)) << 32));
+    record->cell = readUInt16(data + 16);
+    record->value = quint8(data[18]);
+    record->kind = quint8(data[19]);
+    return record->kind <= GameEnd;
+}
+
+static QString segmentName(int number)
+{
+    return QString("journal-%1.gjl").arg(number, 8, 10, QChar('0'));
+}
+
+GameJournal::GameJournal(const QString &directory, QObject *parent)
+    : QThread(parent),
+      nextGame(1)
+{
+    path = directory;
+    segmentNumber = 0;
+    dropped = 0;
+    stopping = false;
+    writing = false;
+    flushRequested = false;
+
+    // Los identificadores siguen después de los de arranques anteriores
+    QDir().mkpath(path);
+    QStringList files = segmentFiles(path);
+    if (!files.isEmpty())
+        segmentNumber = QFileInfo(files.last()).baseName().section('-', 1).toInt();
+    for (int i = files.size() - 1; i >= 0; --i) {
+        if (quint32 last = lastGameId(files.at(i))) {
+            nextGame.fetchAndStoreRelaxed(int(last + 1));
+            break;
+        }
+    }
+
+    open = openSegment();
+    if (open)
+        start(QThread::LowPriority);
+}
+
+/*!
+ * Escribe lo que quede pendiente antes de terminar.
+ */
+GameJournal::~GameJournal()
+{
+    {
+        QMutexLocker locker(&mutex);
+        stopping = true;
+        wakeWriter.wakeOne();
+    }
+    wait();
+    segment.close();
+}
+
+/*!
+ * Abre la bitácora en el directorio de GATO_JOURNAL, o regresa 0 si no está definida.
+ */
+GameJournal *GameJournal::fromEnvironment(QObject *parent)
+{
+    const QString directory = QString::fromLocal8Bit(qgetenv("GATO_JOURNAL"));
+    if (directory.isEmpty())
+        return 0;
+
+    GameJournal *journal = new GameJournal(directory, parent);
+    if (!journal->isOpen()) {
+        qWarning("No se pudo abrir la bitácora en %s", qPrintable(directory));
+        delete journal;
+        return 0;
+    }
+    return journal;
+}
+
+/*!
+ * Segmentos del directorio, del más antiguo al más reciente.
+ */
+QStringList GameJournal::segmentFiles(const QString &directory)
+{
+    QDir dir(directory);
+    QStringList files;
+    foreach (const QString &name, dir.entryList(QStringList("journal-*.gjl"), QDir::Files,
+                                                QDir::Name))
+        files << dir.absoluteFilePath(name);
+    return files;
+}
+
+bool GameJournal::isOpen() const
+{
+    return open;
+}
+
+QString GameJournal::directory() const
+{
+    return path;
+}
+
+/*!
+ * Registra el inicio de una partida y regresa su identificador, único entre
+ * todos los segmentos del directorio.
+ */
+quint32 GameJournal::startGame(int rows, int columns, int winLength)
+{
+    if (!open)
+        return 0;
+
+    JournalRecord record;
+    record.game = quint32(nextGame.fetchAndAddRelaxed(1));
+    record.kind = JournalRecord::GameStart;
+    record.cell = quint16((rows << 8) | columns);
+    record.value = quint8(winLength);
+    append(record);
+    return record.game;
+}
+
+/*!
+ * La jugada número moveNumber (desde 1) de la partida.
+ */
+void GameJournal::recordMove(quint32 game, int moveNumber, int cell, GameState::Mark mark)
+{
+    JournalRecord record;
+    record.game = game;
+    record.sequence = quint32(moveNumber);
+    record.kind = JournalRecord::Move;
+    record.cell = quint16(cell);
+    record.value = quint8(mark);
+    append(record);
+}
+
+/*!
+ * Fin de la partida después de moveCount jugadas, con un GameEngine::Result o
+ * JournalRecord::Abandoned.
+ */
+void GameJournal::finishGame(quint32 game, int moveCount, int result)
+{
+    JournalRecord record;
+    record.game = game;
+    record.sequence = quint32(moveCount + 1);
+    record.kind = JournalRecord::GameEnd;
+    record.value = quint8(result);
+    append(record);
+}
+
+/*!
+ * Copia el registro al buffer pendiente; nunca espera al disco. Si el escritor
+ * se atrasa más de MaxPendingSize, el registro se descarta y se cuenta.
+ */
+void GameJournal::append(const JournalRecord &record)
+{
+    if (!open)
+        return;
+
+    JournalRecord stamped = record;
+    if (!stamped.timestamp)
+        stamped.timestamp = QDateTime::currentMSecsSinceEpoch();
+
+    QMutexLocker locker(&mutex);
+    if (pending.size() + JournalRecord::Size > MaxPendingSize) {
+        ++dropped;
+        Metrics::add(Metrics::JournalDropped);
+        return;
+    }
+    const int offset = pending.size();
+    pending.resize(offset + JournalRecord::Size);
+    stamped.encode(pending.data() + offset);
+    Metrics::add(Metrics::JournalRecords);
+    if (pending.size() >= BatchSize)
+        wakeWriter.wakeOne();
+}
+
+quint64 GameJournal::droppedRecords() const
+{
+    QMutexLocker locker(&mutex);
+    return dropped;
+}
+
+/*!
+ * Espera a que todo lo registrado hasta ahora esté escrito; para pruebas y al salir.
+ */
+void GameJournal::flush()
+{
+    if (!open)
+        return;
+
+    QMutexLocker locker(&mutex);
+    flushRequested = true;
+    wakeWriter.wakeOne();
+    while (flushRequested || writing || !pending.isEmpty())
+        batchWritten.wait(&mutex);
+}
+
+/*!
+ * Hilo escritor: junta lo registrado durante FlushInterval ms (o hasta BatchSize
+ * bytes) y lo escribe de una vez.
+ */
+void GameJournal::run()
+{
+    forever {
+        QByteArray batch;
+        {
+            QMutexLocker locker(&mutex);
+            while (!stopping && !flushRequested && pending.size() < BatchSize) {
+                if (!wakeWriter.wait(&mutex, FlushInterval))
+                    break;
+            }
+            batch.swap(pending);
+            flushRequested = false;
+            writing = !batch.isEmpty();
+            if (batch.isEmpty() && stopping) {
+                batchWritten.wakeAll();
+                break;
+            }
+        }
+
+        // Lo que no se pudo escribir cuenta como descartado
+        const int lost = batch.isEmpty() ? 0
+                                         : (batch.size() - writeBatch(batch)) / JournalRecord::Size;
+
+        QMutexLocker locker(&mutex);
+        if (lost > 0) {
+            dropped += lost;
+            Metrics::add(Metrics::JournalDropped, lost);
+        }
+        writing = false;
+        batchWritten.wakeAll();
+    }
+}
+
+/*!
+ * Escribe el lote, pasando a un segmento nuevo cuando el actual se llena, y lo
+ * manda al disco antes de tomar el siguiente. Regresa los bytes de registros
+ * completos que se escribieron. Si una escritura falla se cierra el segmento:
+ * el siguiente lote empieza otro, y el registro que haya quedado a medias al
+ * final del anterior lo ignoran los lectores.
+ */
+int GameJournal::writeBatch(const QByteArray &data)
+{
+    int offset = 0;
+    while (offset < data.size()) {
+        if ((!segment.isOpen() || segment.size() + JournalRecord::Size > MaxSegmentSize)
+                && !openSegment()) {
+            segment.close();
+            return offset;
+        }
+
+        const qint64 room = (MaxSegmentSize - segment.size()) / JournalRecord::Size
+                            * JournalRecord::Size;
+        const int chunk = int(qMin(qint64(data.size() - offset), room));
+        const qint64 written = segment.write(data.constData() + offset, chunk);
+        if (written != chunk) {
+            segment.close();
+            return offset + int(qMax(written, Q_INT64_C(0))) / JournalRecord::Size
+                    * JournalRecord::Size;
+        }
+        offset += chunk;
+    }
+
+    // Si falla, no se sabe qué parte del lote llegó al disco: se cuenta todo
+    if (!segment.flush()) {
+        segment.close();
+        return 0;
+    }
+#if defined(Q_OS_LINUX)
+    fdatasync(segment.handle());
+#elif defined(Q_OS_UNIX)
+    fsync(segment.handle());
+#endif
+    return offset;
+}
+
+/*!
+ * Empieza el siguiente segmento con su cabecera.
+ */
+bool GameJournal::openSegment()
+{
+    segment.close();
+    segment.setFileName(QDir(path).absoluteFilePath(segmentName(++segmentNumber)));
+    if (!segment.open(QIODevice::WriteOnly))
+        return false;
+
+    char header[HeaderSize];
+    memcpy(header, Magic, MagicSize);
+    writeUInt32(header + 8, FormatVersion);
+    writeUInt32(header + 12, JournalRecord::Size);
+    return segment.write(header, HeaderSize) == HeaderSize;
+}
+
+/*!
+ * Identificador de la última partida que empezó en el segmento, o 0 si no hay.
+ * Los inicios van en orden creciente, así que basta buscar desde el final.
+ */
+quint32 GameJournal::lastGameId(const QString &fileName)
+{
+    QFile file(fileName);
+    if (!file.open(QIODevice::ReadOnly) || file.size() < HeaderSize)
+        return 0;
+
+    const qint64 count = (file.size() - HeaderSize) / JournalRecord::Size;
+    const char *data = reinterpret_cast<const char *>(file.map(0, file.size()));
+    if (!data)
+        return 0;
+
+    quint32 last = 0;
+    JournalRecord record;
+    for (qint64 i = count - 1; i >= 0 && !last; --i) {
+        if (JournalRecord::decode(data + HeaderSize + i * JournalRecord::Size, &record)
+                && record.kind == JournalRecord::GameStart)
+            last = record.game;
+    }
+    file.unmap(reinterpret_cast<uchar *>(const_cast<char *>(data)));
+    return last;
+}
+
+JournalReader::Stats::Stats()
+{
+    records = 0;
+    games = 0;
+    finishedGames = 0;
+    moves = 0;
+    errors = 0;
+}
+
+JournalReader::JournalReader()
+{
+}
+
+JournalReader::~JournalReader()
+{
+    close();
+}
+
+/*!
+ * Mapea un segmento, o todos los de un directorio en orden. Un registro a
+ * medias al final (una escritura interrumpida) se ignora.
+ */
+bool JournalReader::open(const QString &path)
+{
+    close();
+    const QStringList files = QFileInfo(path).isDir() ? GameJournal::segmentFiles(path)
+                                                      : QStringList(path);
+    foreach (const QString &fileName, files) {
+        QFile *file = new QFile(fileName);
+        const char *data = 0;
+        if (file->open(QIODevice::ReadOnly) && file->size() >= HeaderSize)
+            data = reinterpret_cast<const char *>(file->map(0, file->size()));
+        if (!data || memcmp(data, Magic, MagicSize) != 0
+                || readUInt32(data + 8) != FormatVersion
+                || readUInt32(data + 12) != quint32(JournalRecord::Size)) {
+            delete file;
+            close();
+            return false;
+        }
+
+        Segment segment;
+        segment.file = file;
+        segment.records = data + HeaderSize;
+        segment.count = (file->size() - HeaderSize) / JournalRecord::Size;
+        segments << segment;
+    }
+    return !segments.isEmpty();
+}
+
+void JournalReader::close()
+{
+    foreach (const Segment &segment, segments)
+        delete segment.file;
+    segments.clear();
+}
+
+int JournalReader::segmentCount() const
+{
+    return segments.size();
+}
+
+qint64 JournalReader::recordCount() const
+{
+    qint64 count = 0;
+    foreach (const Segment &segment, segments)
+        count += segment.count;
+    return count;
+}
+
+/*!
+ * Decodifica el registro número index contando desde el primer segmento.
+ */
+bool JournalReader::record(qint64 index, JournalRecord *record) const
+{
+    foreach (const Segment &segment, segments) {
+        if (index < segment.count)
+            return JournalRecord::decode(segment.records + index * JournalRecord::Size, record);
+        index -= segment.count;
+    }
+    return false;
+}
+
+/*
+ * Partida en curso durante la verificación. El tablero de 3x3 se sigue con dos
+ * máscaras y la tabla resuelta; los demás con un GameEngine reciclado.
+ */
+struct ReplayGame
+{
+    quint32 next;
+    int cells;
+    int lastMark;
+    int result;
+    quint16 marks[2];
+    GameEngine *engine;
+};
+
+static void fail(JournalReader::Stats *stats, const JournalRecord &record, const char *reason)
+{
+    if (!stats->errors++) {
+        stats->firstError = QString("partida %1, registro %2: %3")
+                .arg(record.game).arg(record.sequence).arg(QString::fromUtf8(reason));
+    }
+}
+
+static void failDamaged(JournalReader::Stats *stats, int segment, qint64 index)
+{
+    if (!stats->errors++) {
+        stats->firstError = QString("segmento %1, registro %2: registro dañado")
+                .arg(segment + 1).arg(index);
+    }
+}
+
+/*!
+ * Reproduce todas las partidas. Las que no terminan antes del final de la
+ * bitácora no cuentan como error (pueden seguir en curso).
+ */
+JournalReader::Stats JournalReader::verify() const
+{
+    Stats stats;
+    QHash<quint32, ReplayGame> games;
+    QList<GameEngine *> spareEngines;
+    JournalRecord record;
+
+    for (int s = 0; s < segments.size(); ++s) {
+        const Segment &segment = segments.at(s);
+        const char *data = segment.records;
+        for (qint64 i = 0; i < segment.count; ++i, data += JournalRecord::Size) {
+            ++stats.records;
+            if (!JournalRecord::decode(data, &record)) {
+                failDamaged(&stats, s, i);
+                continue;
+            }
+
+            if (record.kind == JournalRecord::GameStart) {
+                const int rows = record.cell >> 8;
+                const int columns = record.cell & 0xff;
+                const int winLength = record.value;
+                if (games.contains(record.game) || record.sequence != 0
+                        || rows < 1 || rows > GameState::MaxSide || columns < 1
+                        || columns > GameState::MaxSide || winLength < 1
+                        || winLength > qMin(qMax(rows, columns), int(GameEngine::MaxWinLength))) {
+                    fail(&stats, record, "inicio inválido");
+                    continue;
+                }
+                ReplayGame game;
+                game.next = 1;
+                game.cells = rows * columns;
+                game.lastMark = GameState::Empty;
+                game.result = GameEngine::InProgress;
+                game.marks[0] = game.marks[1] = 0;
+                game.engine = 0;
+                if (rows != 3 || columns != 3 || winLength != 3) {
+                    game.engine = spareEngines.isEmpty() ? new GameEngine
+                                                         : spareEngines.takeLast();
+                    game.engine->setSize(rows, columns, winLength);
+                    game.engine->reset();
+                }
+                games.insert(record.game, game);
+                ++stats.games;
+                continue;
+            }
+
+            QHash<quint32, ReplayGame>::iterator it = games.find(record.game);
+            if (it == games.end()) {
+                fail(&stats, record, "partida desconocida");
+                continue;
+            }
+            ReplayGame &game = it.value();
+            if (record.sequence != game.next) {
+                fail(&stats, record, "falta un registro");
+                continue;
+            }
+
+            if (record.kind == JournalRecord::Move) {
+                const int cell = record.cell;
+                const int mark = record.value;
+                if (cell >= game.cells || mark > GameState::Circle || mark == game.lastMark
+                        || game.result != GameEngine::InProgress) {
+                    fail(&stats, record, "jugada inválida");
+                    continue;
+                }
+                if (game.engine) {
+                    if (!game.engine->canPlayAt(cell)) {
+                        fail(&stats, record, "casilla ocupada");
+                        continue;
+                    }
+                    game.engine->play(cell, GameState::Mark(mark));
+                    game.result = game.engine->result();
+                } else {
+                    const quint16 bit = quint16(1 << cell);
+                    if ((game.marks[0] | game.marks[1]) & bit) {
+                        fail(&stats, record, "casilla ocupada");
+                        continue;
+                    }
+                    game.marks[mark] |= bit;
+                    const int index = SolvedTable::index(game.marks[0], game.marks[1]);
+                    if (!SolvedTable::isValid(index)) {
+                        fail(&stats, record, "posición imposible");
+                        continue;
+                    }
+                    if (SolvedTable::winningLine(index))
+                        game.result = mark == GameState::Cross ? GameEngine::CrossWon
+                                                               : GameEngine::CircleWon;
+                    else if (SolvedTable::isTerminal(index))
+                        game.result = GameEngine::Draw;
+                }
+                game.lastMark = mark;
+                ++game.next;
+                ++stats.moves;
+                continue;
+            }
+
+            // Fin de la partida: el resultado debe ser el del tablero
+            const bool consistent = record.value == JournalRecord::Abandoned
+                    ? game.result == GameEngine::InProgress
+                    : record.value == game.result;
+            if (!consistent)
+                fail(&stats, record, "resultado distinto al del tablero");
+            if (game.engine)
+                spareEngines << game.engine;
+            games.erase(it);
+            ++stats.finishedGames;
+        }
+    }
+
+    foreach (const ReplayGame &game, games) {
+        if (game.engine)
+            spareEngines << game.engine;
+    }
+    qDeleteAll(spareEngines);
+    return stats;
+}
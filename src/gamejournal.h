@@ -0,0 +1,146 @@
+#ifndef GAMEJOURNAL_H
+#define GAMEJOURNAL_H
+
+#include <QAtomicInt>
+#include <QByteArray>
+#include <QFile>
+#include <QList>
+#include <QMutex>
+#include <QString>
+#include <QStringList>
+#include <QThread>
+#include <QWaitCondition>
+
+#include "gameengine.h"
+#include "gamestate.h"
+
+/*
+ * Registro de la bitácora: 24 bytes fijos en little-endian con la partida, el
+ * número de registro dentro de la partida, la hora (ms desde 1970), la casilla,
+ * un valor y el tipo, más una suma de verificación de los 20 bytes anteriores.
+ * - GameStart: secuencia 0, casilla = filas << 8 | columnas, valor = marcas para ganar.
+ * - Move: secuencia = número de jugada (desde 1), casilla y marca.
+ * - GameEnd: secuencia = jugadas + 1, valor = GameEngine::Result o Abandoned.
+ */
+struct JournalRecord
+{
+    enum Kind { GameStart, Move, GameEnd };
+
+    static const int Size = 24;
+    static const int Abandoned = 4;
+
+    JournalRecord();
+
+    void encode(char *data) const;
+    static bool decode(const char *data, JournalRecord *record);
+
+    quint32 game;
+    quint32 sequence;
+    qint64 timestamp;
+    quint16 cell;
+    quint8 value;
+    quint8 kind;
+};
+
+/*
+ * Bitácora de partidas de solo agregar, para auditorías y disputas. Quien juega
+ * solo copia el registro a un buffer en memoria (bajo un candado que se suelta
+ * de inmediato); un hilo propio lo escribe en lotes al archivo del segmento
+ * actual y lo manda al disco, así registrar una jugada no agrega latencia.
+ * Cada arranque empieza un segmento nuevo (journal-00000001.gjl, ...) y uno
+ * lleno se cierra al pasar de MaxSegmentSize.
+ */
+class GameJournal : public QThread
+{
+    Q_OBJECT
+
+public:
+    static const int FlushInterval = 50;              // ms entre escrituras
+    static const int BatchSize = 64 * 1024;           // bytes que despiertan al escritor antes
+    static const int MaxPendingSize = 16 * 1024 * 1024;
+    static const qint64 MaxSegmentSize = Q_INT64_C(64) * 1024 * 1024;
+
+    GameJournal(const QString &directory, QObject *parent = 0);
+    ~GameJournal();
+
+    static GameJournal *fromEnvironment(QObject *parent = 0);
+    static QStringList segmentFiles(const QString &directory);
+
+    bool isOpen() const;
+    QString directory() const;
+
+    quint32 startGame(int rows, int columns, int winLength);
+    void recordMove(quint32 game, int moveNumber, int cell, GameState::Mark mark);
+    void finishGame(quint32 game, int moveCount, int result);
+    void append(const JournalRecord &record);
+
+    quint64 droppedRecords() const;
+    void flush();
+
+protected:
+    void run();
+
+private:
+    bool openSegment();
+    int writeBatch(const QByteArray &data);
+    static quint32 lastGameId(const QString &fileName);
+
+    QString path;
+    QFile segment;
+    int segmentNumber;
+    bool open;
+
+    mutable QMutex mutex;
+    QWaitCondition wakeWriter;
+    QWaitCondition batchWritten;
+    QByteArray pending;
+    quint64 dropped;
+    bool stopping;
+    bool writing;
+    bool flushRequested;
+    QAtomicInt nextGame;
+};
+
+/*
+ * Lee los segmentos de una bitácora mapeados en memoria (sin copiarlos) y
+ * reproduce las partidas para verificar que cada registro sea válido: sumas de
+ * verificación, secuencias sin huecos, casillas libres, turnos alternados y que
+ * el resultado anotado sea el que da el tablero.
+ */
+class JournalReader
+{
+public:
+    struct Stats {
+        Stats();
+
+        quint64 records;
+        quint64 games;
+        quint64 finishedGames;
+        quint64 moves;
+        quint64 errors;
+        QString firstError;
+    };
+
+    JournalReader();
+    ~JournalReader();
+
+    bool open(const QString &path);
+    void close();
+
+    int segmentCount() const;
+    qint64 recordCount() const;
+    bool record(qint64 index, JournalRecord *record) const;
+
+    Stats verify() const;
+
+private:
+    struct Segment {
+        QFile *file;
+        const char *records;
+        qint64 count;
+    };
+
+    QList<Segment> segments;
+};
+
+#endif
@@ -0,0 +1,363 @@
+#include "gamestate.h"
+#include "gameengine.h"
+
+static const int TextSize = BOARDSIZE + 2;
+static const int PackedSize = 3;
+static const int PackedHeaderSize = 4;
+
+static const char statusChars[] = { 'P', '1', '2', 'N' };
+static const char markChars[] = { 'X', 'O', '-' };
+
+/*
+ * Tablero vacío de 3x3 compartido por todos los estados creados con el
+ * constructor por omisión; cada uno hace su propia copia al modificarlo.
+ */
+static const QVector<GameState::Mark> &emptyClassicCells()
+{
+    static const QVector<GameState::Mark> cells(BOARDSIZE, GameState::Empty);
+    return cells;
+}
+
+GameState::GameState()
+    : cells(emptyClassicCells())
+{
+    status = Playing;
+    senderMark = Cross;
+    rows = 3;
+    columns = 3;
+    winLength = 3;
+}
+
+GameState::GameState(int rows, int columns, int winLength)
+{
+    status = Playing;
+    senderMark = Cross;
+    this->rows = rows;
+    this->columns = columns;
+    this->winLength = winLength;
+    cells.fill(Empty, rows * columns);
+}
+
+/*!
+ * Indica si es el tablero de 3x3, el único que entienden los nodos anteriores.
+ */
+bool GameState::isClassic() const
+{
+    return rows == 3 && columns == 3 && winLength == 3;
+}
+
+bool GameState::sameDimensions(const GameState &other) const
+{
+    return rows == other.rows && columns == other.columns && winLength == other.winLength;
+}
+
+/*!
+ * Indica si este estado es base con a lo más una casilla vacía recién marcada,
+ * es decir, si se puede mandar como una jugada (GameDelta). En cell queda la
+ * casilla marcada, o GameDelta::NoCell si el tablero no cambió.
+ */
+bool GameState::followsFrom(const GameState &base, int *cell) const
+{
+    if (!sameDimensions(base) || cells.size() != base.cells.size())
+        return false;
+
+    *cell = GameDelta::NoCell;
+    const Mark *mine = cells.constData();
+    const Mark *theirs = base.cells.constData();
+    for (int i = 0; i < cells.size(); ++i) {
+        if (mine[i] == theirs[i])
+            continue;
+        if (*cell != GameDelta::NoCell || theirs[i] != Empty)
+            return false;
+        *cell = i;
+    }
+    return true;
+}
+
+void GameState::clearCells()
+{
+    cells.fill(Empty);
+}
+
+/*!
+ * Hash del tablero: el xor de la clave de cada casilla marcada, así una jugada
+ * lo actualiza en O(1) con cellKey().
+ */
+quint32 GameState::hash() const
+{
+    quint32 h = 0;
+    for (int i = 0; i < cells.size(); ++i)
+        h ^= cellKey(i, cells.at(i));
+    return h;
+}
+
+quint32 GameState::cellKey(int cell, Mark mark)
+{
+    if (mark == Empty)
+        return 0;
+    // Mezcla de MurmurHash3 sobre (casilla, marca)
+    quint32 k = (quint32(cell) * 2 + quint32(mark) + 1) * 0x9e3779b9u;
+    k ^= k >> 16;
+    k *= 0x85ebca6bu;
+    k ^= k >> 13;
+    k *= 0xc2b2ae35u;
+    k ^= k >> 16;
+    return k;
+}
+
+/*
+ * Dimensiones válidas para un tablero recibido por la red.
+ */
+static bool validDimensions(int rows, int columns, int winLength)
+{
+    return rows > 0 && rows <= GameState::MaxSide && columns > 0 && columns <= GameState::MaxSide
+            && winLength > 0 && winLength <= qMax(rows, columns)
+            && winLength <= GameEngine::MaxWinLength;
+}
+
+static bool readStatus(char c, GameState::Status *status)
+{
+    switch (c) {
+    case 'P': *status = GameState::Playing; break;
+    case '1': *status = GameState::P1Won; break;
+    case '2': *status = GameState::P2Won; break;
+    case 'N': *status = GameState::NobodyWon; break;
+    default: return false;
+    }
+    return true;
+}
+
+static bool readCells(const char *text, int count, GameState *state)
+{
+    for (int i = 0; i < count; ++i) {
+        const char c = text[i];
+        if (c == 'X')
+            state->cells[i] = GameState::Cross;
+        else if (c == 'O')
+            state->cells[i] = GameState::Circle;
+        else if (c == '-')
+            state->cells[i] = GameState::Empty;
+        else
+            return false;
+    }
+    return true;
+}
+
+/*!
+ * Formato texto: {1/2/N/P}{E/C}{Tablero}
+ * Ej: 'PE--XX--O-O' Donde P indica que aún se está jugando (P para Playing, N nadie ganó,
+ * 1 y 2 determinan quién fue el ganador), E que el jugador enviando el mensaje juega
+ * con el símbolo X (E = X, C = O) y '--XX--O-O' Es el estado actual del tablero.
+ * Otros tableros agregan sus dimensiones antes de las casillas: 'PE15x15x5:---...'.
+ */
+QByteArray GameState::toText() const
+{
+    QByteArray text;
+    text.reserve(cells.size() + 16);
+    text += statusChars[status];
+    text += senderMark == Circle ? 'C' : 'E';
+    if (!isClassic()) {
+        text += QByteArray::number(rows) + 'x' + QByteArray::number(columns)
+                + 'x' + QByteArray::number(winLength) + ':';
+    }
+    for (int i = 0; i < cells.size(); ++i)
+        text += markChars[cells[i]];
+    return text;
+}
+
+bool GameState::fromText(const QByteArray &text, GameState *state)
+{
+    if (text.size() < 2 || !readStatus(text.at(0), &state->status))
+        return false;
+
+    if (text.at(1) == 'E')
+        state->senderMark = Cross;
+    else if (text.at(1) == 'C')
+        state->senderMark = Circle;
+    else
+        return false;
+
+    int start = 2;
+    int rows = 3, columns = 3, winLength = 3;
+    const int colon = text.indexOf(':', start);
+    if (colon != -1) {
+        QList<QByteArray> dimensions = text.mid(start, colon - start).split('x');
+        if (dimensions.size() != 3)
+            return false;
+        rows = dimensions.at(0).toInt();
+        columns = dimensions.at(1).toInt();
+        winLength = dimensions.at(2).toInt();
+        if (!validDimensions(rows, columns, winLength))
+            return false;
+        start = colon + 1;
+    } else if (text.size() != TextSize) {
+        return false;
+    }
+
+    if (text.size() - start != rows * columns)
+        return false;
+    state->rows = rows;
+    state->columns = columns;
+    state->winLength = winLength;
+    state->cells.resize(rows * columns);
+    return readCells(text.constData() + start, rows * columns, state);
+}
+
+/*!
+ * Formato binario: 2 bits por casilla (bits 0-17), estado (bits 18-19) y
+ * símbolo de quien envía (bit 20), en 3 bytes little-endian.
+ * Otros tableros: filas, columnas, marcas para ganar, un byte con el estado
+ * (bits 0-1) y el símbolo (bit 2), y luego las casillas a 2 bits cada una.
+ * Se distinguen por la longitud: el formato extendido nunca mide 3 bytes.
+ */
+QByteArray GameState::pack() const
+{
+    if (!isClassic()) {
+        QByteArray data(PackedHeaderSize + (cells.size() + 3) / 4, 0);
+        data[0] = char(rows);
+        data[1] = char(columns);
+        data[2] = char(winLength);
+        data[3] = char(status | (senderMark == Circle ? 4 : 0));
+        for (int i = 0; i < cells.size(); ++i)
+            data[PackedHeaderSize + i / 4] = char(data.at(PackedHeaderSize + i / 4)
+                                                  | (cells[i] << (2 * (i % 4))));
+        return data;
+    }
+
+    quint32 bits = 0;
+    for (int i = 0; i < BOARDSIZE; ++i)
+        bits |= quint32(cells[i]) << (2 * i);
+    bits |= quint32(status) << (2 * BOARDSIZE);
+    bits |= quint32(senderMark == Circle) << (2 * BOARDSIZE + 2);
+
+    QByteArray data(PackedSize, 0);
+    data[0] = char(bits & 0xff);
+    data[1] = char((bits >> 8) & 0xff);
+    data[2] = char((bits >> 16) & 0xff);
+    return data;
+}
+
+bool GameState::unpack(const QByteArray &data, GameState *state)
+{
+    if (data.size() != PackedSize) {
+        if (data.size() < PackedHeaderSize)
+            return false;
+        const uchar *bytes = reinterpret_cast<const uchar *>(data.constData());
+        const int rows = bytes[0], columns = bytes[1], winLength = bytes[2];
+        if (!validDimensions(rows, columns, winLength) || (bytes[3] >> 3)
+                || data.size() != PackedHeaderSize + (rows * columns + 3) / 4)
+            return false;
+
+        state->rows = rows;
+        state->columns = columns;
+        state->winLength = winLength;
+        state->status = Status(bytes[3] & 3);
+        state->senderMark = bytes[3] & 4 ? Circle : Cross;
+        state->cells.resize(rows * columns);
+        for (int i = 0; i < rows * columns; ++i) {
+            const int mark = (bytes[PackedHeaderSize + i / 4] >> (2 * (i % 4))) & 3;
+            if (mark > Empty)
+                return false;
+            state->cells[i] = Mark(mark);
+        }
+        return true;
+    }
+
+    const quint32 bits = quint32(quint8(data.at(0)))
+            | (quint32(quint8(data.at(1))) << 8)
+            | (quint32(quint8(data.at(2))) << 16);
+    if (bits >> (2 * BOARDSIZE + 3))
+        return false;
+
+    state->rows = 3;
+    state->columns = 3;
+    state->winLength = 3;
+    state->cells.resize(BOARDSIZE);
+    for (int i = 0; i < BOARDSIZE; ++i) {
+        const quint32 mark = (bits >> (2 * i)) & 3;
+        if (mark > Empty)
+            return false;
+        state->cells[i] = Mark(mark);
+    }
+    state->status = Status((bits >> (2 * BOARDSIZE)) & 3);
+    state->senderMark = (bits >> (2 * BOARDSIZE + 2)) & 1 ? Circle : Cross;
+    return true;
+}
+
+GameDelta::GameDelta()
+{
+    sequence = 0;
+    cell = NoCell;
+    mark = GameState::Empty;
+    status = GameState::Playing;
+    senderMark = GameState::Cross;
+    boardHash = 0;
+}
+
+/*!
+ * Formato: secuencia (32 bits), casilla (16 bits), un byte con la marca (bits 0-1),
+ * el estado (bits 2-3) y el símbolo de quien envía (bit 4), y el hash (32 bits).
+ * Los enteros van en orden de red.
+ */
+QByteArray GameDelta::pack() const
+{
+    QByteArray data(PackedSize, 0);
+    data[0] = char(sequence >> 24);
+    data[1] = char(sequence >> 16);
+    data[2] = char(sequence >> 8);
+    data[3] = char(sequence);
+    data[4] = char(cell >> 8);
+    data[5] = char(cell);
+    data[6] = char(mark | (status << 2) | (senderMark == GameState::Circle ? 16 : 0));
+    data[7] = char(boardHash >> 24);
+    data[8] = char(boardHash >> 16);
+    data[9] = char(boardHash >> 8);
+    data[10] = char(boardHash);
+    return data;
+}
+
+bool GameDelta::unpack(const QByteArray &data, GameDelta *delta)
+{
+    if (data.size() != PackedSize)
+        return false;
+
+    const uchar *bytes = reinterpret_cast<const uchar *>(data.constData());
+    if ((bytes[6] >> 5) || (bytes[6] & 3) > GameState::Empty)
+        return false;
+
+    delta->sequence = (quint32(bytes[0]) << 24) | (quint32(bytes[1]) << 16)
+                      | (quint32(bytes[2]) << 8) | quint32(bytes[3]);
+    delta->cell = (int(bytes[4]) << 8) | bytes[5];
+    delta->mark = GameState::Mark(bytes[6] & 3);
+    delta->status = GameState::Status((bytes[6] >> 2) & 3);
+    delta->senderMark = bytes[6] & 16 ? GameState::Circle : GameState::Cross;
+    delta->boardHash = (quint32(bytes[7]) << 24) | (quint32(bytes[8]) << 16)
+                       | (quint32(bytes[9]) << 8) | quint32(bytes[10]);
+    return (delta->cell == NoCell) == (delta->mark == GameState::Empty);
+}
+
+/*!
+ * Aplica la jugada sobre state y actualiza su hash. Si la partida anterior ya
+ * había terminado, la jugada es la primera de una nueva y se aplica sobre el
+ * tablero vacío; quien la manda hace lo mismo. Regresa false si la casilla no
+ * existe o ya estaba ocupada, sin modificar nada.
+ */
+bool GameDelta::applyTo(GameState *state, quint32 *hash) const
+{
+    if (cell != NoCell && (cell >= state->cells.size()
+                           || (state->status == GameState::Playing
+                               && state->cells.at(cell) != GameState::Empty)))
+        return false;
+
+    if (state->status != GameState::Playing) {
+        state->clearCells();
+        *hash = 0;
+    }
+    if (cell != NoCell) {
+        state->cells[cell] = mark;
+        *hash ^= GameState::cellKey(cell, mark);
+    }
+    state->status = status;
+    state->senderMark = senderMark;
+    return true;
+}
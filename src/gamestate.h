@@ -0,0 +1,83 @@
+#ifndef GAMESTATE_H
+#define GAMESTATE_H
+
+#include <QByteArray>
+#include <QMetaType>
+#include <QVector>
+
+/* Casillas del tablero clásico de 3x3 */
+const short int BOARDSIZE = 9;
+
+/*
+ * Estado del juego tal como viaja por la red: estado de la partida, símbolo de
+ * quien manda el mensaje, dimensiones del tablero (filas, columnas y cuántas
+ * marcas seguidas ganan) y las casillas, fila por fila.
+ * Se puede codificar como texto ('PE--XX--O-O') para nodos con el protocolo
+ * anterior o empaquetado en 3 bytes para el protocolo binario. Los tableros
+ * distintos al de 3x3 llevan además sus dimensiones.
+ */
+struct GameState
+{
+    enum Status { Playing, P1Won, P2Won, NobodyWon };
+    enum Mark { Cross, Circle, Empty };
+
+    /*
+     * Lado máximo del tablero. Al empaquetar, las filas y las columnas van en un
+     * byte cada una (igual que en la bitácora), así que no pueden pasar de 255;
+     * con 255x255 el índice de una casilla todavía cabe en 16 bits (GameDelta).
+     */
+    static const int MaxSide = 255;
+
+    GameState();
+    GameState(int rows, int columns, int winLength);
+
+    bool isClassic() const;
+    bool sameDimensions(const GameState &other) const;
+    bool followsFrom(const GameState &base, int *cell) const;
+    void clearCells();
+    quint32 hash() const;
+    static quint32 cellKey(int cell, Mark mark);
+
+    QByteArray toText() const;
+    static bool fromText(const QByteArray &text, GameState *state);
+    QByteArray pack() const;
+    static bool unpack(const QByteArray &data, GameState *state);
+
+    Status status;
+    Mark senderMark;
+    int rows;
+    int columns;
+    int winLength;
+    QVector<Mark> cells;
+};
+
+Q_DECLARE_METATYPE(GameState)
+
+/*
+ * Una sola jugada sobre un estado que el otro nodo ya conoce: la casilla (o
+ * NoCell si solo cambia el estado de la partida), su marca, el estado de la
+ * partida y el símbolo de quien la manda. Mide lo mismo sin importar el tamaño
+ * del tablero. El número de secuencia cuenta las jugadas desde el último estado
+ * completo y el hash es el del tablero ya con la jugada, así quien la recibe
+ * detecta si le falta una o si su copia ya no coincide.
+ */
+struct GameDelta
+{
+    static const int NoCell = 0xffff;
+    static const int PackedSize = 11;
+
+    GameDelta();
+
+    QByteArray pack() const;
+    static bool unpack(const QByteArray &data, GameDelta *delta);
+    bool applyTo(GameState *state, quint32 *hash) const;
+
+    quint32 sequence;
+    int cell;
+    GameState::Mark mark;
+    GameState::Status status;
+    GameState::Mark senderMark;
+    quint32 boardHash;
+};
+
+#endif
@@ -0,0 +1,123 @@
+#include "latencyhistogram.h"
+
+static const int SubBucketBits = 4;
+static const int SubBuckets = 1 << SubBucketBits;
+static const int MaxExponent = 62;
+static const int BucketCount = SubBuckets + (MaxExponent - SubBucketBits + 1) * SubBuckets;
+
+LatencyHistogram::LatencyHistogram()
+{
+    samples = 0;
+    smallest = 0;
+    largest = 0;
+    sum = 0;
+}
+
+/*!
+ * Registra una muestra; los valores negativos cuentan como 0.
+ */
+void LatencyHistogram::record(qint64 value)
+{
+    if (value < 0)
+        value = 0;
+    const int bucket = bucketOf(value);
+    if (bucket >= buckets.size())
+        buckets.resize(bucket + 1);
+    ++buckets[bucket];
+    if (!samples || value < smallest)
+        smallest = value;
+    if (!samples || value > largest)
+        largest = value;
+    ++samples;
+    sum += value;
+}
+
+/*!
+ * Suma las muestras de otro histograma, por ejemplo el de otro hilo.
+ */
+void LatencyHistogram::merge(const LatencyHistogram &other)
+{
+    if (!other.samples)
+        return;
+    if (other.buckets.size() > buckets.size())
+        buckets.resize(other.buckets.size());
+    for (int i = 0; i < other.buckets.size(); ++i)
+        buckets[i] += other.buckets.at(i);
+    smallest = samples ? qMin(smallest, other.smallest) : other.smallest;
+    largest = samples ? qMax(largest, other.largest) : other.largest;
+    samples += other.samples;
+    sum += other.sum;
+}
+
+void LatencyHistogram::clear()
+{
+    buckets.clear();
+    samples = 0;
+    smallest = 0;
+    largest = 0;
+    sum = 0;
+}
+
+quint64 LatencyHistogram::count() const
+{
+    return samples;
+}
+
+qint64 LatencyHistogram::minimum() const
+{
+    return smallest;
+}
+
+qint64 LatencyHistogram::maximum() const
+{
+    return largest;
+}
+
+double LatencyHistogram::mean() const
+{
+    return samples ? sum / samples : 0.0;
+}
+
+/*!
+ * Valor bajo el cual queda la fracción dada de las muestras (0.5 para p50,
+ * 0.999 para p999). Regresa el límite superior de la cubeta, sin pasar del máximo visto.
+ */
+qint64 LatencyHistogram::percentile(double fraction) const
+{
+    if (!samples)
+        return 0;
+
+    const quint64 rank = quint64(qBound(0.0, fraction, 1.0) * (samples - 1)) + 1;
+    quint64 seen = 0;
+    for (int i = 0; i < buckets.size(); ++i) {
+        seen += buckets.at(i);
+        if (seen >= rank && i + 1 < BucketCount)
+            return qBound(smallest, bucketValue(i + 1) - 1, largest);
+    }
+    return largest;
+}
+
+int LatencyHistogram::bucketOf(qint64 value)
+{
+    if (value < SubBuckets)
+        return int(value);
+
+    int exponent = 63;
+    while (!(quint64(value) >> exponent))
+        --exponent;
+    const int sub = int((quint64(value) >> (exponent - SubBucketBits)) & (SubBuckets - 1));
+    return SubBuckets + (exponent - SubBucketBits) * SubBuckets + sub;
+}
+
+/*!
+ * Valor más pequeño que cae en la cubeta.
+ */
+qint64 LatencyHistogram::bucketValue(int bucket)
+{
+    if (bucket < SubBuckets)
+        return bucket;
+
+    const int exponent = (bucket - SubBuckets) / SubBuckets + SubBucketBits;
+    const int sub = (bucket - SubBuckets) % SubBuckets;
+    return (qint64(SubBuckets + sub)) << (exponent - SubBucketBits);
+}
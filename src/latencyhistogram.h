@@ -0,0 +1,41 @@
+#ifndef LATENCYHISTOGRAM_H
+#define LATENCYHISTOGRAM_H
+
+#include <QVector>
+
+/*
+ * Histograma de latencias con cubetas log-lineales: los valores menores a 16 se
+ * guardan exactos y a partir de ahí cada potencia de 2 se divide en 16 cubetas,
+ * con un error relativo máximo de ~6%. Ocupa lo mismo sin importar cuántas
+ * muestras se registren, así que sirve para corridas largas; las cubetas se
+ * reservan solo hasta la del valor más grande visto, así que uno vacío es pequeño
+ * y se puede tener uno por conexión.
+ * Las unidades las decide quien lo usa (microsegundos en la mayoría de los casos).
+ */
+class LatencyHistogram
+{
+public:
+    LatencyHistogram();
+
+    void record(qint64 value);
+    void merge(const LatencyHistogram &other);
+    void clear();
+
+    quint64 count() const;
+    qint64 minimum() const;
+    qint64 maximum() const;
+    double mean() const;
+    qint64 percentile(double fraction) const;
+
+private:
+    static int bucketOf(qint64 value);
+    static qint64 bucketValue(int bucket);
+
+    QVector<quint64> buckets;
+    quint64 samples;
+    qint64 smallest;
+    qint64 largest;
+    double sum;
+};
+
+#endif
@@ -0,0 +1,163 @@
+#include "loadclient.h"
+#include "loadgenerator.h"
+
+#include <QCoreApplication>
+#include <QStringList>
+
+LoadClient::LoadClient(int id, LoadGroup *group)
+    : QObject(group)
+{
+    clientId = id;
+    this->group = group;
+    connection = 0;
+    myMark = GameState::Cross;
+    opponentId = -1;
+    scriptSeed = quint32(id) * 2654435761u + 1;
+    connectStarted = 0;
+    greetingStarted = 0;
+    failed = false;
+
+    const LoadSettings &settings = group->settings();
+    engine.setSize(settings.rows, settings.columns, settings.winLength);
+    greeting = QString("load-%1-%2").arg(QCoreApplication::applicationPid()).arg(id);
+
+    moveTimer.setSingleShot(true);
+    connect(&moveTimer, SIGNAL(timeout()), this, SLOT(playMove()));
+}
+
+void LoadClient::start(const QHostAddress &address, quint16 port)
+{
+    connection = new Connection(this);
+    connection->setGreetingMessage(greeting);
+    connect(connection, SIGNAL(connected()), this, SLOT(connected()));
+    connect(connection, SIGNAL(readyForUse()), this, SLOT(readyForUse()));
+    connect(connection, SIGNAL(newGameState(GameState)),
+            this, SLOT(gameStateReceived(GameState)));
+    connect(connection, SIGNAL(disconnected()), this, SLOT(connectionError()));
+    connect(connection, SIGNAL(error(QAbstractSocket::SocketError)),
+            this, SLOT(connectionError()));
+
+    connectStarted = group->now();
+    connection->connectToHost(address, port);
+}
+
+int LoadClient::id() const
+{
+    return clientId;
+}
+
+void LoadClient::connected()
+{
+    greetingStarted = group->now();
+    group->recordConnect(greetingStarted - connectStarted);
+}
+
+/*!
+ * El servidor nos mandó el nombre del oponente como saludo. Los dos comparan sus
+ * nombres para decidir quién juega con X sin tener que negociarlo.
+ */
+void LoadClient::readyForUse()
+{
+    group->recordGreeting(group->now() - greetingStarted);
+
+    const QString opponent = connection->name().section('@', 0, 0);
+    const QStringList fields = opponent.split('-');
+    opponentId = -1;
+    if (fields.size() == 3 && fields.at(1).toLongLong() == QCoreApplication::applicationPid())
+        opponentId = fields.at(2).toInt();
+
+    myMark = greeting < opponent ? GameState::Cross : GameState::Circle;
+    startGame();
+}
+
+void LoadClient::startGame()
+{
+    engine.reset();
+    if (myMark == GameState::Cross)
+        moveTimer.start(group->settings().movesPerSecond > 0
+                        ? int(1000 / group->settings().movesPerSecond) : 0);
+}
+
+/*!
+ * Jugada del oponente (o su última jugada, si la partida terminó).
+ */
+void LoadClient::gameStateReceived(const GameState &gameState)
+{
+    group->recordMove(opponentId);
+
+    if (gameState.status != GameState::Playing) {
+        group->countGame();
+        startGame();
+        return;
+    }
+
+    engine.load(gameState);
+    moveTimer.start(group->settings().movesPerSecond > 0
+                    ? int(1000 / group->settings().movesPerSecond) : 0);
+}
+
+void LoadClient::playMove()
+{
+    if (failed || engine.result() != GameEngine::InProgress)
+        return;
+
+    const int pos = chooseMove();
+    if (!engine.play(pos, myMark))
+        return;
+
+    GameState state(engine.rows(), engine.columns(), engine.winLength());
+    engine.store(&state);
+    state.senderMark = myMark;
+    switch (engine.result()) {
+    case GameEngine::CrossWon:
+    case GameEngine::CircleWon:
+        state.status = GameState::P1Won;
+        break;
+    case GameEngine::Draw:
+        state.status = GameState::NobodyWon;
+        break;
+    default:
+        state.status = GameState::Playing;
+    }
+
+    group->markSent(clientId);
+    connection->sendGameState(state);
+
+    if (state.status != GameState::Playing)
+        startGame();
+}
+
+/*!
+ * En modo guion la jugada es una casilla libre elegida con un generador
+ * congruencial con semilla fija por cliente: reproducible y casi sin costo.
+ */
+int LoadClient::chooseMove()
+{
+    if (group->settings().mode == LoadSettings::Bot) {
+        AiPlayer *bot = group->bot();
+        const int pos = bot->chooseMove(engine, myMark);
+        group->recordSearch(bot->lastSearch());
+        return pos;
+    }
+
+    scriptSeed = scriptSeed * 1103515245u + 12345u;
+    const int free = engine.cellCount() - engine.moveCount();
+    int skip = int((scriptSeed >> 16) % quint32(free));
+    for (int pos = 0; pos < engine.cellCount(); ++pos) {
+        if (engine.canPlayAt(pos) && skip-- == 0)
+            return pos;
+    }
+    return -1;
+}
+
+/*!
+ * Durante la prueba ninguna conexión debería cerrarse: cualquier cierre es un error.
+ */
+void LoadClient::connectionError()
+{
+    if (failed)
+        return;
+    failed = true;
+    moveTimer.stop();
+    group->countError();
+}
@@ -0,0 +1,54 @@
+#ifndef LOADCLIENT_H
+#define LOADCLIENT_H
+
+#include <QHostAddress>
+#include <QObject>
+#include <QTimer>
+
+#include "connection.h"
+#include "gameengine.h"
+
+class LoadGroup;
+
+/*
+ * Un jugador automático del generador de carga. Se conecta al servidor, manda
+ * el saludo y, ya emparejado, juega partidas seguidas a la velocidad indicada,
+ * con jugadas de guion (casillas en un orden pseudoaleatorio fijo) o del bot.
+ * Empieza cada partida con X el jugador de identificador menor.
+ */
+class LoadClient : public QObject
+{
+    Q_OBJECT
+
+public:
+    LoadClient(int id, LoadGroup *group);
+
+    void start(const QHostAddress &address, quint16 port);
+    int id() const;
+
+private slots:
+    void connected();
+    void readyForUse();
+    void gameStateReceived(const GameState &gameState);
+    void playMove();
+    void connectionError();
+
+private:
+    int chooseMove();
+    void startGame();
+
+    int clientId;
+    QString greeting;
+    LoadGroup *group;
+    Connection *connection;
+    GameEngine engine;
+    QTimer moveTimer;
+    GameState::Mark myMark;
+    int opponentId;
+    quint32 scriptSeed;
+    qint64 connectStarted;
+    qint64 greetingStarted;
+    bool failed;
+};
+
+#endif
@@ -0,0 +1,29 @@
+#-------------------------------------------------
+#
+# Generador de carga: muchos clientes automáticos contra el servidor dedicado
+#
+#-------------------------------------------------
+
+QT	+= core network
+QT	-= gui
+
+TARGET = GatoLoadGen
+CONFIG	+= console
+CONFIG	-= app_bundle
+TEMPLATE = app
+
+include(../core.pri)
+
+INCLUDEPATH += ../dedicated
+DEPENDPATH += ../dedicated
+
+SOURCES	+=  main.cpp \
+	    loadclient.cpp \
+	    loadgenerator.cpp \
+	    ../dedicated/gameserver.cpp \
+	    ../dedicated/gamesession.cpp
+
+HEADERS  += loadclient.h \
+	    loadgenerator.h \
+	    ../dedicated/gameserver.h \
+	    ../dedicated/gamesession.h
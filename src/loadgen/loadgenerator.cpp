@@ -0,0 +1,320 @@
+#include "loadgenerator.h"
+#include "loadclient.h"
+#include "gameserver.h"
+
+#include <QTextStream>
+
+static const int RampTick = 10; // ms
+
+LoadSettings::LoadSettings()
+{
+    clients = 100;
+    movesPerSecond = 1;
+    duration = 30;
+    connectRate = 1000;
+    threads = qMax(1, QThread::idealThreadCount() / 2);
+    serverThreads = qMax(1, QThread::idealThreadCount() / 2);
+    reportInterval = 5;
+    mode = Scripted;
+    botDepth = 2;
+    rows = 3;
+    columns = 3;
+    winLength = 3;
+    address = QHostAddress::LocalHost;
+    port = 0;
+}
+
+/* La profundidad que queda es la mayor alcanzada */
+static void addSearch(AiPlayer::Stats *total, const AiPlayer::Stats &search)
+{
+    total->nodes += search.nodes;
+    total->tableProbes += search.tableProbes;
+    total->tableHits += search.tableHits;
+    total->elapsed += search.elapsed;
+    total->depth = qMax(total->depth, search.depth);
+}
+
+LoadStats::LoadStats()
+{
+    ready = 0;
+    movesSent = 0;
+    movesReceived = 0;
+    games = 0;
+    errors = 0;
+}
+
+void LoadStats::merge(const LoadStats &other)
+{
+    connect.merge(other.connect);
+    greeting.merge(other.greeting);
+    move.merge(other.move);
+    ready += other.ready;
+    movesSent += other.movesSent;
+    movesReceived += other.movesReceived;
+    games += other.games;
+    errors += other.errors;
+    addSearch(&search, other.search);
+}
+
+LoadGroup::LoadGroup(LoadGenerator *generator)
+    : rampTimer(this)
+{
+    this->generator = generator;
+    player.setMaxDepth(generator->settings().botDepth);
+    nextId = 0;
+    lastId = 0;
+    batchSize = 1;
+    connect(&rampTimer, SIGNAL(timeout()), this, SLOT(startBatch()));
+}
+
+const LoadSettings &LoadGroup::settings() const
+{
+    return generator->settings();
+}
+
+qint64 LoadGroup::now() const
+{
+    return generator->now();
+}
+
+/*!
+ * El bot se comparte entre los clientes del hilo: su tabla de transposición
+ * ocupa más que todo lo demás de un cliente.
+ */
+AiPlayer *LoadGroup::bot()
+{
+    return &player;
+}
+
+void LoadGroup::markSent(int clientId)
+{
+    generator->markSent(clientId, generator->now());
+    QMutexLocker locker(&mutex);
+    ++counters.movesSent;
+}
+
+/*!
+ * Registra una jugada recibida; el reloj es el mismo para todo el proceso, así
+ * que la latencia es la del viaje completo cliente -> servidor -> cliente.
+ */
+void LoadGroup::recordMove(int opponentId)
+{
+    const qint64 sent = opponentId >= 0 ? generator->sentAt(opponentId) : -1;
+    const qint64 latency = generator->now() - sent;
+    QMutexLocker locker(&mutex);
+    ++counters.movesReceived;
+    if (sent >= 0)
+        counters.move.record(latency);
+}
+
+void LoadGroup::recordConnect(qint64 usecs)
+{
+    QMutexLocker locker(&mutex);
+    counters.connect.record(usecs);
+}
+
+void LoadGroup::recordGreeting(qint64 usecs)
+{
+    QMutexLocker locker(&mutex);
+    counters.greeting.record(usecs);
+    ++counters.ready;
+}
+
+void LoadGroup::recordSearch(const AiPlayer::Stats &search)
+{
+    QMutexLocker locker(&mutex);
+    addSearch(&counters.search, search);
+}
+
+void LoadGroup::countGame()
+{
+    QMutexLocker locker(&mutex);
+    ++counters.games;
+}
+
+void LoadGroup::countError()
+{
+    QMutexLocker locker(&mutex);
+    ++counters.errors;
+}
+
+LoadStats LoadGroup::stats() const
+{
+    QMutexLocker locker(&mutex);
+    return counters;
+}
+
+/*!
+ * Crea los clientes en este hilo y los conecta de a poco, para no desbordar la
+ * cola de conexiones pendientes del servidor.
+ */
+void LoadGroup::startClients(int firstId, int count)
+{
+    nextId = firstId;
+    lastId = firstId + count;
+    const int perSecond = qMax(1, settings().connectRate / qMax(1, settings().threads));
+    batchSize = qMax(1, perSecond * RampTick / 1000);
+    rampTimer.start(RampTick);
+    startBatch();
+}
+
+void LoadGroup::startBatch()
+{
+    for (int i = 0; i < batchSize && nextId < lastId; ++i, ++nextId) {
+        LoadClient *client = new LoadClient(nextId, this);
+        clients << client;
+        client->start(settings().address, settings().port);
+    }
+    if (nextId >= lastId)
+        rampTimer.stop();
+}
+
+LoadGenerator::LoadGenerator(const LoadSettings &settings, QObject *parent)
+    : QObject(parent),
+      config(settings)
+{
+    server = 0;
+    movesAtLastReport = 0;
+    lastReport = 0;
+    sentTimes.fill(-1, config.clients);
+    connect(&reportTimer, SIGNAL(timeout()), this, SLOT(report()));
+}
+
+LoadGenerator::~LoadGenerator()
+{
+    foreach (QThread *thread, threads) {
+        thread->quit();
+        thread->wait();
+        delete thread;
+    }
+}
+
+/*!
+ * Levanta el servidor interno si hace falta y arranca los hilos de clientes.
+ */
+bool LoadGenerator::start()
+{
+    QTextStream out(stdout);
+    if (config.port == 0) {
+        server = new GameServer(0, this);
+        if (!server->isListening())
+            return false;
+        server->setWorkerThreads(config.serverThreads);
+        config.address = QHostAddress::LocalHost;
+        config.port = server->serverPort();
+        out << "servidor interno en el puerto " << config.port
+            << " con " << config.serverThreads << " hilos" << endl;
+    }
+
+    qRegisterMetaType<GameState>("GameState");
+    qRegisterMetaType<QAbstractSocket::SocketError>("QAbstractSocket::SocketError");
+
+    clock.start();
+    const int count = qMax(1, qMin(config.threads, config.clients));
+    int first = 0;
+    for (int i = 0; i < count; ++i) {
+        const int clients = config.clients / count + (i < config.clients % count ? 1 : 0);
+        QThread *thread = new QThread;
+        LoadGroup *group = new LoadGroup(this);
+        group->moveToThread(thread);
+        connect(thread, SIGNAL(finished()), group, SLOT(deleteLater()));
+        thread->start();
+        threads << thread;
+        groups << group;
+        QMetaObject::invokeMethod(group, "startClients", Qt::QueuedConnection,
+                                  Q_ARG(int, first), Q_ARG(int, clients));
+        first += clients;
+    }
+
+    if (config.reportInterval > 0)
+        reportTimer.start(config.reportInterval * 1000);
+    QTimer::singleShot(config.duration * 1000, this, SLOT(finish()));
+    return true;
+}
+
+const LoadSettings &LoadGenerator::settings() const
+{
+    return config;
+}
+
+/*!
+ * Reloj común a todos los hilos, en microsegundos.
+ */
+qint64 LoadGenerator::now() const
+{
+    return clock.nsecsElapsed() / 1000;
+}
+
+void LoadGenerator::markSent(int clientId, qint64 usecs)
+{
+    QMutexLocker locker(&sentMutex);
+    sentTimes[clientId] = usecs;
+}
+
+qint64 LoadGenerator::sentAt(int clientId) const
+{
+    QMutexLocker locker(&sentMutex);
+    return clientId < sentTimes.size() ? sentTimes.at(clientId) : -1;
+}
+
+LoadStats LoadGenerator::collect() const
+{
+    LoadStats total;
+    foreach (LoadGroup *group, groups)
+        total.merge(group->stats());
+    return total;
+}
+
+void LoadGenerator::report()
+{
+    const LoadStats stats = collect();
+    const qint64 elapsed = clock.elapsed();
+    const double seconds = (elapsed - lastReport) / 1000.0;
+    QTextStream out(stdout);
+    out << "t=" << elapsed / 1000 << "s jugadas/s="
+        << (seconds > 0 ? (stats.movesReceived - movesAtLastReport) / seconds : 0.0) << ' ';
+    movesAtLastReport = stats.movesReceived;
+    lastReport = elapsed;
+    printStats(stats);
+}
+
+void LoadGenerator::finish()
+{
+    reportTimer.stop();
+    const LoadStats stats = collect();
+    QTextStream out(stdout);
+    out << "total jugadas/s=" << (clock.elapsed() > 0
+                                  ? stats.movesReceived * 1000.0 / clock.elapsed() : 0.0) << ' ';
+    printStats(stats);
+    emit finished();
+}
+
+/*!
+ * Una línea clave=valor; las latencias en microsegundos. En modo bot también
+ * los nodos por segundo de la búsqueda (por hilo) y los aciertos en la tabla
+ * de transposición.
+ */
+void LoadGenerator::printStats(const LoadStats &stats)
+{
+    QTextStream out(stdout);
+    out << "listos=" << stats.ready << '/' << config.clients
+        << " errores=" << stats.errors
+        << " enviadas=" << stats.movesSent
+        << " recibidas=" << stats.movesReceived
+        << " partidas=" << stats.games;
+
+    const LatencyHistogram *histograms[] = { &stats.connect, &stats.greeting, &stats.move };
+    const char *names[] = { "conexion", "saludo", "jugada" };
+    for (int i = 0; i < 3; ++i) {
+        out << ' ' << names[i] << "_p50=" << histograms[i]->percentile(0.5)
+            << ' ' << names[i] << "_p99=" << histograms[i]->percentile(0.99)
+            << ' ' << names[i] << "_p999=" << histograms[i]->percentile(0.999)
+            << ' ' << names[i] << "_max=" << histograms[i]->maximum();
+    }
+    if (config.mode == LoadSettings::Bot) {
+        out << " bot_nodos/s=" << stats.search.nodesPerSecond()
+            << " bot_aciertos_tabla=" << stats.search.hitRate()
+            << " bot_profundidad=" << stats.search.depth;
+    }
+    out << endl;
+}
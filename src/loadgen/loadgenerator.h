@@ -0,0 +1,144 @@
+#ifndef LOADGENERATOR_H
+#define LOADGENERATOR_H
+
+#include <QElapsedTimer>
+#include <QHostAddress>
+#include <QList>
+#include <QMutex>
+#include <QObject>
+#include <QThread>
+#include <QTimer>
+#include <QVector>
+
+#include "aiplayer.h"
+#include "latencyhistogram.h"
+
+class GameServer;
+class LoadClient;
+class LoadGenerator;
+
+struct LoadSettings
+{
+    enum Mode { Scripted, Bot };
+
+    LoadSettings();
+
+    int clients;
+    double movesPerSecond;  // por partida; 0 = sin pausa entre jugadas
+    int duration;           // segundos
+    int connectRate;        // conexiones nuevas por segundo
+    int threads;
+    int serverThreads;      // hilos del servidor interno
+    int reportInterval;     // segundos, 0 = solo el reporte final
+    Mode mode;
+    int botDepth;
+    int rows;
+    int columns;
+    int winLength;
+    QHostAddress address;
+    quint16 port;           // 0 = levantar un servidor propio en loopback
+};
+
+/*
+ * Contadores y latencias de un grupo de clientes. Las latencias van en microsegundos.
+ */
+struct LoadStats
+{
+    LoadStats();
+    void merge(const LoadStats &other);
+
+    LatencyHistogram connect;   // connectToHost() -> connected()
+    LatencyHistogram greeting;  // connected() -> saludo del servidor (ya emparejado)
+    LatencyHistogram move;      // jugada enviada -> recibida por el oponente
+    quint64 ready;
+    quint64 movesSent;
+    quint64 movesReceived;
+    quint64 games;
+    quint64 errors;
+    AiPlayer::Stats search;     // búsquedas del bot, sumadas
+};
+
+/*
+ * Clientes que corren en un mismo hilo, con su propio bot y sus estadísticas.
+ */
+class LoadGroup : public QObject
+{
+    Q_OBJECT
+
+public:
+    LoadGroup(LoadGenerator *generator);
+
+    const LoadSettings &settings() const;
+    qint64 now() const;
+    AiPlayer *bot();
+    void markSent(int clientId);
+    void recordMove(int opponentId);
+
+    void recordConnect(qint64 usecs);
+    void recordGreeting(qint64 usecs);
+    void recordSearch(const AiPlayer::Stats &search);
+    void countGame();
+    void countError();
+    LoadStats stats() const;
+
+public slots:
+    void startClients(int firstId, int count);
+
+private slots:
+    void startBatch();
+
+private:
+    LoadGenerator *generator;
+    AiPlayer player;
+    QList<LoadClient *> clients;
+    QTimer rampTimer;
+    int nextId;
+    int lastId;
+    int batchSize;
+    mutable QMutex mutex;
+    LoadStats counters;
+};
+
+/*
+ * Generador de carga: reparte los clientes entre hilos, los conecta poco a poco
+ * al servidor (uno propio en loopback si no se indica puerto) y reporta latencias
+ * y rendimiento cada cierto tiempo y al terminar.
+ */
+class LoadGenerator : public QObject
+{
+    Q_OBJECT
+
+public:
+    LoadGenerator(const LoadSettings &settings, QObject *parent = 0);
+    ~LoadGenerator();
+
+    bool start();
+    const LoadSettings &settings() const;
+    qint64 now() const;
+    void markSent(int clientId, qint64 usecs);
+    qint64 sentAt(int clientId) const;
+
+signals:
+    void finished();
+
+private slots:
+    void report();
+    void finish();
+
+private:
+    void printStats(const LoadStats &stats);
+    LoadStats collect() const;
+
+    LoadSettings config;
+    GameServer *server;
+    QList<QThread *> threads;
+    QList<LoadGroup *> groups;
+    QElapsedTimer clock;
+    mutable QMutex sentMutex;
+    QVector<qint64> sentTimes;
+    QTimer reportTimer;
+    quint64 movesAtLastReport;
+    qint64 lastReport;
+};
+
+#endif
@@ -0,0 +1,88 @@
+#include <QCoreApplication>
+#include <QStringList>
+#include <QTextStream>
+
+#include "loadgenerator.h"
+
+#ifdef Q_OS_UNIX
+#include <sys/resource.h>
+#endif
+
+/*!
+ * Sube el límite de descriptores de archivo al máximo permitido, cada cliente
+ * ocupa uno (y otro más en el servidor interno).
+ */
+static void raiseFileLimit()
+{
+#ifdef Q_OS_UNIX
+    struct rlimit limit;
+    if (getrlimit(RLIMIT_NOFILE, &limit) == 0 && limit.rlim_cur < limit.rlim_max) {
+        limit.rlim_cur = limit.rlim_max;
+        setrlimit(RLIMIT_NOFILE, &limit);
+    }
+#endif
+}
+
+/*
+ * Uso: GatoLoadGen [clave=valor ...]
+ *   clientes=100 jugadas=1 (por segundo y partida, 0 = sin pausa) segundos=30
+ *   conexiones=1000 (por segundo) hilos=N hilos_servidor=N reporte=5 (segundos)
+ *   modo=guion|bot profundidad=2 tablero=3x3x3
+ *   host=127.0.0.1 puerto=0 (0 = servidor interno en loopback)
+ */
+int main(int argc, char *argv[])
+{
+    QCoreApplication a(argc, argv);
+    raiseFileLimit();
+
+    LoadSettings settings;
+    QTextStream out(stdout);
+    foreach (const QString &arg, a.arguments().mid(1)) {
+        const QString key = arg.section('=', 0, 0);
+        const QString value = arg.section('=', 1);
+        if (key == "clientes")
+            settings.clients = value.toInt();
+        else if (key == "jugadas")
+            settings.movesPerSecond = value.toDouble();
+        else if (key == "segundos")
+            settings.duration = value.toInt();
+        else if (key == "conexiones")
+            settings.connectRate = value.toInt();
+        else if (key == "hilos")
+            settings.threads = value.toInt();
+        else if (key == "hilos_servidor")
+            settings.serverThreads = value.toInt();
+        else if (key == "reporte")
+            settings.reportInterval = value.toInt();
+        else if (key == "modo")
+            settings.mode = value == "bot" ? LoadSettings::Bot : LoadSettings::Scripted;
+        else if (key == "profundidad")
+            settings.botDepth = value.toInt();
+        else if (key == "tablero" && value.split('x').size() == 3) {
+            settings.rows = value.split('x').at(0).toInt();
+            settings.columns = value.split('x').at(1).toInt();
+            settings.winLength = value.split('x').at(2).toInt();
+        } else if (key == "host")
+            settings.address = QHostAddress(value);
+        else if (key == "puerto")
+            settings.port = value.toUShort();
+        else {
+            out << "Opción desconocida: " << arg << endl;
+            return 2;
+        }
+    }
+
+    if (settings.clients <= 0 || settings.threads <= 0 || settings.duration <= 0) {
+        out << "clientes, hilos y segundos deben ser mayores a 0" << endl;
+        return 2;
+    }
+
+    LoadGenerator generator(settings);
+    QObject::connect(&generator, SIGNAL(finished()), &a, SLOT(quit()));
+    if (!generator.start()) {
+        out << "No se pudo levantar el servidor interno" << endl;
+        return 1;
+    }
+
+    return a.exec();
+}
@@ -1,9 +1,11 @@
 #include "mainwindow.h"
+#include "metricsendpoint.h"
 #include <QApplication>
 
 int main(int argc, char *argv[])
 {
     QApplication a(argc, argv);
+    MetricsEndpoint::fromEnvironment(&a);
     MainWindow w;
     w.show();
 
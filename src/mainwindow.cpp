@@ -1,5 +1,6 @@
 #include "mainwindow.h"
 #include "ui_mainwindow.h"
+#include "metrics.h"
 
 MainWindow::MainWindow(QWidget *parent) :
     QMainWindow(parent),
@@ -7,37 +8,41 @@ MainWindow::MainWindow(QWidget *parent) :
 {
     ui->setupUi(this);
 
-    /* Paleta de colores para los botones, dependiendo del jugador */
-    paletteWinner.setColor(QPalette::ButtonText, Qt::black);
-    paletteWinner.setColor(QPalette::Button, Qt::green);
-    normalPallete.setColor(QPalette::ButtonText, Qt::black);
-    normalPallete.setColor(QPalette::Button, Qt::white);
-    p1Pallete.setColor(QPalette::ButtonText, Qt::black);
-    p1Pallete.setColor(QPalette::Button, Qt::red);
-    p2Pallete.setColor(QPalette::ButtonText, Qt::black);
-    p2Pallete.setColor(QPalette::Button, Qt::blue);
-
-    /* QList que contiene los botones de la ui para poder trabajar con ellos */
-    buttonList.append(ui->pushButton);
-    buttonList.append(ui->pushButton_2);
-    buttonList.append(ui->pushButton_3);
-    buttonList.append(ui->pushButton_4);
-    buttonList.append(ui->pushButton_5);
-    buttonList.append(ui->pushButton_6);
-    buttonList.append(ui->pushButton_7);
-    buttonList.append(ui->pushButton_8);
-    buttonList.append(ui->pushButton_9);
-
-    for (int i=0;i<BOARDSIZE;i++){
-        buttonList.at(i)->setDisabled(true);
-        connect(buttonList.at(i), SIGNAL(clicked()), this, SLOT(updateUiBoard()));
-        buttonList.at(i)->setPalette (normalPallete);
-    }
+    /* El tablero se dibuja en un solo widget, que avisa qué casilla se presionó */
+    ui->board->setDisabled(true);
+    connect(ui->board, SIGNAL(cellClicked(int)), this, SLOT(updateUiBoard(int)));
 
     /* Conexiones señales-slots */
-    connect(&client, SIGNAL(newMessage(QString)), this, SLOT(appendGameState(QString)));
+    connect(&client, SIGNAL(newGameState(GameState)), this, SLOT(appendGameState(GameState)));
     connect(&client, SIGNAL(newOponent(QString)), this, SLOT(newOponent(QString)));
     connect(&client, SIGNAL(oponentLeft()), this, SLOT(oponentLeft()));
+    connect(&client, SIGNAL(oponentSuspended()), this, SLOT(oponentSuspended()));
+    connect(&client, SIGNAL(oponentResumed()), this, SLOT(oponentResumed()));
+    connect(ui->pushButton_Bot, SIGNAL(clicked()), this, SLOT(startBotGame()));
+
+    /* Dificultad de la computadora: profundidad en jugadas y tiempo máximo en ms */
+    botGame = false;
+    bool ok;
+    int botDepth = qgetenv("GATO_BOT_DEPTH").toInt(&ok);
+    if (ok)
+        bot.setMaxDepth(botDepth);
+    int botTime = qgetenv("GATO_BOT_TIME").toInt(&ok);
+    if (ok)
+        bot.setTimeBudget(botTime);
+
+    journal = GameJournal::fromEnvironment(this);
+    journalGame = 0;
+    journalMoves = 0;
+
+    /* Al terminar una partida el resultado se avisa sin bloquear: la red y los
+     * pings se siguen atendiendo, y la revancha empieza sola o al cerrar el aviso */
+    resultBox = new QMessageBox(this);
+    resultBox->setIcon(QMessageBox::Information);
+    resultBox->setWindowModality(Qt::NonModal);
+    connect(resultBox, SIGNAL(finished(int)), this, SLOT(rematch()));
+    rematchTimer.setSingleShot(true);
+    rematchTimer.setInterval(RematchDelay);
+    connect(&rematchTimer, SIGNAL(timeout()), this, SLOT(rematch()));
 
     myNickName = client.nickName();
     ui->label_P1H->setText (myNickName);
@@ -50,38 +55,65 @@ MainWindow::~MainWindow()
 }
 
 /*!
- *Actualiza el tablero y el estado del juego cuando se presiona un botón
+ *Actualiza el tablero y el estado del juego cuando se presiona la casilla pos
  */
-void MainWindow::updateUiBoard()
+void MainWindow::updateUiBoard(int pos)
 {
-    if(playerState == myTurn){
-        for (int i=0; i<BOARDSIZE;i++ ){
-            if(buttonList.at(i) == dynamic_cast<QPushButton*>(sender())){
-                if(canPlayAtPos(i)){
-                    if(myMark==Cross){
-                        maxPlay++;
-                        ui->label->setText ("Turno de tu oponente");
-                        buttonList.at(i)->setText ("X");
-                        buttonList.at(i)->setPalette (p1Pallete);
-                        ui->label_Mark->setText ("'X'");
-                        playerState = oponentTurn;
-                        board.replace(i, Cross);
-                        client.sendMessage(composeGameState());
-                    } else {
-                        maxPlay++;
-                        buttonList.at(i)->setText("O");
-                        buttonList.at(i)->setPalette (p2Pallete);
-                        ui->label_Mark->setText ("'O'");
-                        playerState = oponentTurn;
-                        ui->label->setText ("Turno de tu oponente");
-                        board.replace(i, Circle);
-                        client.sendMessage(composeGameState());
-                    }
-                }
-            }
-        }
-    }
+    if (gameState != Playing)
+        return;
+    if(playerState == myTurn && canPlayAtPos(pos))
+        playMove(pos);
     checkWinner();
+
+    /* Contra la computadora su jugada llega como si viniera de la red */
+    if(botGame && playerState == oponentTurn)
+        QTimer::singleShot(0, this, SLOT(botMove()));
+}
+
+/*!
+ * Marca nuestra jugada en el tablero y la manda al oponente.
+ */
+void MainWindow::playMove(int pos)
+{
+    if (engine.moveCount() == 0)
+        Metrics::add(Metrics::GamesStarted);
+    if(myMark==Cross){
+        ui->label_Mark->setText ("'X'");
+        engine.play(pos, GameState::Cross);
+    } else {
+        ui->label_Mark->setText ("'O'");
+        engine.play(pos, GameState::Circle);
+    }
+    ui->board->setCell(pos, engine.at(pos));
+    journalMove(pos);
+    ui->label->setText ("Turno de tu oponente");
+    playerState = oponentTurn;
+    client.sendGameState(composeGameState());
+}
+
+/*!
+ * Anota en la bitácora la jugada recién hecha en pos, empezando la partida si es la primera.
+ */
+void MainWindow::journalMove(int pos)
+{
+    if (!journal)
+        return;
+    if (!journalGame) {
+        journalGame = journal->startGame(engine.rows(), engine.columns(), engine.winLength());
+        journalMoves = 0;
+    }
+    journal->recordMove(journalGame, ++journalMoves, pos, engine.at(pos));
+}
+
+/*!
+ * Cierra la partida en la bitácora con un GameEngine::Result o JournalRecord::Abandoned.
+ */
+void MainWindow::journalFinish(int result)
+{
+    if (!journal || !journalGame)
+        return;
+    journal->finishGame(journalGame, journalMoves, result);
+    journalGame = 0;
 }
 
 /*!
@@ -92,15 +124,12 @@ void MainWindow::initBoard()
     playerState = myTurn;
     myMark=Cross;
     gameState = Playing;
-    for (int i =0; i<BOARDSIZE;i++){
-        board.append(Empty);
-    }
-    maxPlay=4;
+    engine.reset();
 }
 
 bool MainWindow::canPlayAtPos(int pos)
 {
-    return board.at(pos) == Empty;
+    return engine.canPlayAt(pos);
 }
 
 /*!
@@ -108,45 +137,22 @@ bool MainWindow::canPlayAtPos(int pos)
  */
 bool MainWindow::winner()
 {
-    for (int i=0; i<3; ++i) {
-        if (board[i] != Empty && board[i] == board[i+3] && board[i] == board[i+6]){
-            buttonList.at(i)->setPalette(paletteWinner);
-            buttonList.at(i+3)->setPalette(paletteWinner);
-            buttonList.at(i+6)->setPalette(paletteWinner);
-            return true;
-        }
+    QList<int> line = engine.winningLine();
+    if (line.isEmpty())
+        return false;
 
-        if (board[i*3] != Empty && board[i*3] == board[i*3+1] && board[i*3] == board[i*3+2]){
-            buttonList.at(i*3)->setPalette(paletteWinner);
-            buttonList.at(i*3+1)->setPalette(paletteWinner);
-            buttonList.at(i*3+2)->setPalette(paletteWinner);
-            return true;
-        }
-    }
-
-    if (board[0] != Empty && board[0] == board[4] && board[0] == board[8]){
-        buttonList.at(0)->setPalette(paletteWinner);
-        buttonList.at(4)->setPalette(paletteWinner);
-        buttonList.at(8)->setPalette(paletteWinner);
-        return true;
-    }
-
-    if (board[2] != Empty && board[2] == board[4] && board[2] == board[6]){
-        buttonList.at(2)->setPalette(paletteWinner);
-        buttonList.at(4)->setPalette(paletteWinner);
-        buttonList.at(6)->setPalette(paletteWinner);
-        return true;
-    }
-
-    return false;
+    ui->board->setHighlighted(line);
+    return true;
 }
 /*!
  * El loop del juego, cuando hay un ganador, empate o el oponente ha abandonado
- * reinicia el juego para comenzar otra partida o hasta que un oponente entra a jugar
+ * avisa el resultado y regresa de inmediato; la partida queda terminada hasta la
+ * revancha (rematch), así nunca se abre un loop de eventos anidado dentro de un
+ * slot de la red. Si el oponente abandonó no hay revancha: el tablero se limpia
+ * de una vez para esperar al siguiente.
  */
 void MainWindow::restart()
 {
-    QMessageBox info;
     QString msgboxtext;
 
     if(gameState==P1Won)
@@ -158,99 +164,115 @@ void MainWindow::restart()
     if(gameState==P2Left)
         msgboxtext="El oponente ha abandonado";
 
-    //gameState = Playing;
+    if (gameState != P2Left)
+        Metrics::add(Metrics::GamesFinished);
+
+    resultBox->setText(msgboxtext);
+    resultBox->show();
+    QPoint pos = mapToGlobal(QPoint( width()/2  - resultBox->width()/2, height()/2 - resultBox->height()/2 ));
+    resultBox->move(pos);
+
+    ui->board->setDisabled(true);
+    if (gameState == P2Left) {
+        rematchTimer.stop();
+        initBoard();
+        clearBoard();
+        ui->label_Mark->setText ("...");
+    } else if (ui->checkBox_Rematch->isChecked()) {
+        rematchTimer.start();
+    }
+}
 
-    info.setText(msgboxtext);
-    info.setIcon (QMessageBox::Information);
-    info.show();
-    QPoint pos = mapToGlobal(QPoint( width()/2  - info.width()/2, height()/2 - info.height()/2 ));
-    info.move(pos);
-    info.exec();
+/*!
+ * Empieza la siguiente partida: al cerrar el aviso del resultado, al pasar
+ * RematchDelay con la revancha automática o cuando el oponente ya hizo su
+ * primera jugada de la nueva partida.
+ */
+void MainWindow::rematch()
+{
+    rematchTimer.stop();
+    resultBox->hide();
+    if (gameState == Playing)
+        return;
 
-    board.clear ();
     initBoard ();
-
-    for (int i=0;i<BOARDSIZE;i++){
-        buttonList.at(i)->setText("");
-        buttonList.at(i)->setPalette (normalPallete);
-    }
+    clearBoard();
     ui->label->setText ("A jugar!");
     ui->label_Mark->setText ("...");
+    ui->board->setEnabled(botGame || client.isPlaying());
+}
 
+/*!
+ * Deja las casillas del tablero vacías.
+ */
+void MainWindow::clearBoard()
+{
+    ui->board->clear();
 }
 
 /*!
  * Compone el mensaje que se va a enviar de a cuerdo al estado actual del juego
  */
-QString MainWindow::composeGameState()
+GameState MainWindow::composeGameState()
 {
-    QString gState;
+    GameState gState;
 
     if(gameState==Playing){
-        gState.append("P");
+        gState.status = GameState::Playing;
     } else if(gameState==P1Won){
-        gState.append("1");
+        gState.status = GameState::P1Won;
     } else if(gameState==P2Won){
-        gState.append("2");
+        gState.status = GameState::P2Won;
     } else {
-        gState.append("N");
-    }
-
-    if(myMark==Circle){
-        gState.append("C");
-    } else {
-        gState.append("E");
+        gState.status = GameState::NobodyWon;
     }
 
+    gState.senderMark = myMark==Circle ? GameState::Circle : GameState::Cross;
 
-    foreach(PlayerMark Mark, board){
-        if(Mark==Cross){
-            gState.append ("X");
-        } else if (Mark==Circle){
-            gState.append ("O");
-        } else {
-            gState.append ("-");
-        }
-    }
-    qDebug()<<"compose GS - gState"<<gState;
+    engine.store(&gState);
     return gState;
 }
 
 /*!
  * Decodifica el mensaje recibido y actualiza el estado del juego como corresponde.
  */
-void MainWindow::appendGameState(const QString &message)
+void MainWindow::appendGameState(const GameState &message)
 {
-    /* Formato mensaje: {1/2/N/P}{E/C}{Tablero}
-     * Ej: 'PE--XX--O-O' Donde P indica que aún se está jugando (P para Playing, N nadie ganó,
-     * 1 y 2 determinan quién fue el ganador), E que el jugador enviando el mensaje juega
-     * con el símbolo X (E = X, C = O) y '--XX--O-O' Es el estado actual del tablero.
+    /* El mensaje trae el estado de la partida (jugando, quién ganó o empate), el símbolo
+     * con el que juega quien lo envía y el estado actual del tablero.
      */
 
+    /* El oponente ya empezó la revancha mientras se mostraba el resultado; un
+     * estado final repetido (ej. al reanudar la sesión) ya se había mostrado */
+    if (gameState != Playing) {
+        if (message.status != GameState::Playing)
+            return;
+        rematch();
+    }
+
     playerState = myTurn;
 
     /* Lee el tablero actualizado con el movimiento del contrincante recién hecho */
     ui->label->setText ("Tu turno");
-    int index = 0;
-    for (int i = 2; i< BOARDSIZE+2; i++ ){
-        if(message.at(i) == 'X'){
-            board.replace(index, Cross);
-            buttonList.at(index)->setText ("X");
-            buttonList.at(index)->setPalette (p1Pallete);
-        } else if (message.at(i)=='O') {
-            board.replace(index, Circle);
-            buttonList.at(index)->setText ("O");
-            buttonList.at(index)->setPalette (p2Pallete);
-        } else {
-            board.replace(index, Empty);
-            buttonList.at(index)->setText ("");
-            buttonList.at(index)->setPalette (normalPallete);
-        }
-        index++;
+    const bool firstMove = engine.moveCount() == 0;
+    const GameEngine::Result resultBefore = engine.result();
+    GameState previous;
+    engine.store(&previous);
+    if (engine.load(message) && firstMove && engine.moveCount() > 0)
+        Metrics::add(Metrics::GamesStarted);
+    int cell;
+    if (message.followsFrom(previous, &cell) && cell != GameDelta::NoCell)
+        journalMove(cell);
+    if (message.status != GameState::Playing) {
+        /* El estado final puede llegar con el tablero ya vacío, entonces el
+         * resultado es el del tablero que había antes */
+        const GameEngine::Result result = engine.result();
+        journalFinish(result != GameEngine::InProgress ? result : resultBefore);
     }
+    ui->board->setState(message);
 
     /* Actualiza el símbolo con el que jugamos */
-    if(message.at(1)=='E'){
+    if(message.senderMark == GameState::Cross){
         myMark=Circle;
         ui->label_Mark->setText ("'O'");
     } else {
@@ -259,14 +281,14 @@ void MainWindow::appendGameState(const QString &message)
     }
 
     /* Actualiza el estado del juego y comprueba si hay algún ganador */
-    if(message.at(0)=='P'){
+    if(message.status == GameState::Playing){
         gameState=Playing;
-    } else if(message.at(0)=='1'){
+    } else if(message.status == GameState::P1Won){
         gameState=P2Won;
         ui->label->setText ("Tu oponente ha ganado");
         winner();
         restart();
-    } else if(message.at(0)=='2'){
+    } else if(message.status == GameState::P2Won){
         gameState=P1Won;
         ui->label->setText ("Haz ganado!");
         winner();
@@ -284,27 +306,29 @@ void MainWindow::appendGameState(const QString &message)
  */
 void MainWindow::checkWinner()
 {
+    if (engine.result() != GameEngine::InProgress)
+        journalFinish(engine.result());
     if(winner()){
         if(playerState==myTurn){
 
             gameState = P2Won;
             ui->label->setText ("Tu oponente ha ganado");
-            client.sendMessage(composeGameState());
+            client.sendGameState(composeGameState());
             restart ();
         }
         else{
 
             gameState = P1Won;
             ui->label->setText ("Haz ganado");
-            client.sendMessage(composeGameState());
+            client.sendGameState(composeGameState());
             restart ();
 
         }
     } else {
-        if(maxPlay==BOARDSIZE){
+        if(engine.isFull()){
             gameState = NobodyWon;
             ui->label->setText ("Juego empatado");
-            client.sendMessage(composeGameState());
+            client.sendGameState(composeGameState());
             restart ();
         }
     }
@@ -315,11 +339,20 @@ void MainWindow::checkWinner()
  */
 void MainWindow::newOponent(const QString &nick)
 {
+    /* Un oponente de verdad tiene prioridad sobre la computadora */
+    if (botGame) {
+        if (gameState == Playing && engine.moveCount() > 0)
+            Metrics::add(Metrics::GamesAbandoned);
+        journalFinish(JournalRecord::Abandoned);
+        botGame = false;
+        initBoard();
+        clearBoard();
+    }
+    rematch();
+    ui->pushButton_Bot->setDisabled(true);
     ui->label_P2H->setText(nick);
     ui->label->setText ("Oponente encontrado!");
-    for (int i=0;i<BOARDSIZE;i++){
-        buttonList.at(i)->setEnabled(true);
-    }
+    ui->board->setEnabled(true);
 }
 
 /*!
@@ -328,10 +361,80 @@ void MainWindow::newOponent(const QString &nick)
 void MainWindow::oponentLeft()
 {
     ui->label_P2H->setText ("-");
-    for (int i=0;i<BOARDSIZE;i++){
-        buttonList.at(i)->setDisabled(true);
-    }
+    ui->board->setDisabled(true);
+    if (gameState == Playing && engine.moveCount() > 0)
+        Metrics::add(Metrics::GamesAbandoned);
+    journalFinish(JournalRecord::Abandoned);
     gameState=P2Left;
     restart();
     ui->label->setText ("Buscando oponente...");
+    ui->pushButton_Bot->setEnabled(true);
+}
+
+/*!
+ * Se cayó la conexión con el oponente pero la partida sigue: el tablero se
+ * conserva mientras se reconecta, y una jugada hecha mientras tanto se le
+ * manda al volver.
+ */
+void MainWindow::oponentSuspended()
+{
+    ui->label->setText ("Reconectando con tu oponente...");
+}
+
+void MainWindow::oponentResumed()
+{
+    ui->label->setText (playerState == myTurn ? "Tu turno" : "Turno de tu oponente");
+}
+
+/*!
+ * Empieza una partida contra la computadora mientras no haya oponente en la red.
+ */
+void MainWindow::startBotGame()
+{
+    if (client.isPlaying())
+        return;
+
+    botGame = true;
+    rematchTimer.stop();
+    resultBox->hide();
+    initBoard();
+    clearBoard();
+    ui->label_P2H->setText ("Computadora");
+    ui->label->setText ("A jugar!");
+    ui->label_Mark->setText ("'X'");
+    ui->board->setEnabled(true);
+}
+
+/*!
+ * Jugada de la computadora. Se compone el mismo estado que mandaría un oponente
+ * en la red, así el resto del juego no distingue entre uno y otro.
+ */
+void MainWindow::botMove()
+{
+    if (!botGame || playerState != oponentTurn || gameState != Playing)
+        return;
+
+    GameState::Mark botMark = myMark == Cross ? GameState::Circle : GameState::Cross;
+    int pos = bot.chooseMove(engine, botMark);
+    if (pos < 0)
+        return;
+
+    GameEngine next = engine;
+    next.play(pos, botMark);
+
+    GameState state;
+    state.senderMark = botMark;
+    next.store(&state);
+    switch (next.result()) {
+    case GameEngine::CrossWon:
+    case GameEngine::CircleWon:
+        state.status = GameState::P1Won;
+        break;
+    case GameEngine::Draw:
+        state.status = GameState::NobodyWon;
+        break;
+    default:
+        state.status = GameState::Playing;
+    }
+    appendGameState(state);
 }
@@ -4,10 +4,11 @@
 #include <QMainWindow>
 #include <QDebug>
 #include <QMessageBox>
-#include <QButtonGroup>
+#include <QTimer>
+#include "aiplayer.h"
 #include "client.h"
-
-const short int BOARDSIZE = 9;
+#include "gameengine.h"
+#include "gamejournal.h"
 
 namespace Ui {
 class MainWindow;
@@ -24,31 +25,47 @@ public:
     enum StatePlayer { myTurn, oponentTurn };
     enum StateGame {Playing, P1Won, P2Won, NobodyWon, P2Left };
 
+    static const int RematchDelay = 3000; // ms que se muestra el resultado antes de la revancha
+
 public slots:
-    void updateUiBoard();
+    void updateUiBoard(int pos);
     void initBoard();
     bool canPlayAtPos(int pos_);
     bool winner();
     void restart();
 
 private slots:
-    QString composeGameState();
+    GameState composeGameState();
     void newOponent(const QString &nick);
     void oponentLeft();
-    void appendGameState(const QString &message);
+    void oponentSuspended();
+    void oponentResumed();
+    void appendGameState(const GameState &message);
     void checkWinner();
+    void startBotGame();
+    void botMove();
+    void rematch();
 
 private:
+    void playMove(int pos);
+    void clearBoard();
+    void journalMove(int pos);
+    void journalFinish(int result);
+
     Ui::MainWindow *ui;
-    QList<PlayerMark> board; // El tablero se representa como un QList de PlayerMarks.
+    GameEngine engine; // El tablero y las reglas viven en el motor, la ventana solo lo muestra.
     StatePlayer playerState;
     StateGame gameState;
     PlayerMark myMark;
-    int maxPlay;
     Client client;
+    AiPlayer bot;
+    bool botGame; // Se juega contra la computadora mientras no haya oponente en la red
     QString myNickName;
-    QList<QPushButton*> buttonList;
-    QPalette paletteWinner, normalPallete, p1Pallete, p2Pallete;
+    GameJournal *journal; // Con GATO_JOURNAL se anotan las partidas, si no es 0
+    quint32 journalGame;
+    int journalMoves;
+    QMessageBox *resultBox; // Aviso del resultado, no modal para no detener el loop de eventos
+    QTimer rematchTimer;
 };
 
 #endif // MAINWINDOW_H
@@ -0,0 +1,123 @@
+#include "matchmaker.h"
+
+Matchmaker::Matchmaker()
+{
+    lastSessionId = 0;
+}
+
+/*!
+ * Agrega la conexión al final de la cola de espera.
+ */
+void Matchmaker::enqueue(Connection *connection)
+{
+    if (!connection || waiting.contains(connection) || sessionByConnection.contains(connection))
+        return;
+
+    // Si la cola acumula demasiadas entradas de conexiones que ya se fueron, se compacta
+    if (queue.size() > 2 * waiting.size() + 16) {
+        QQueue<Connection *> alive;
+        QSet<Connection *> seen;
+        foreach (Connection *queued, queue) {
+            if (waiting.contains(queued) && !seen.contains(queued)) {
+                seen.insert(queued);
+                alive.enqueue(queued);
+            }
+        }
+        queue = alive;
+    }
+
+    queue.enqueue(connection);
+    waiting.insert(connection);
+}
+
+/*!
+ * Saca de la cola la conexión que lleva más tiempo esperando, o regresa 0 si no hay ninguna.
+ */
+Connection *Matchmaker::takeNext()
+{
+    while (!queue.isEmpty()) {
+        Connection *connection = queue.dequeue();
+        if (waiting.remove(connection))
+            return connection;
+    }
+    return 0;
+}
+
+/*!
+ * Olvida la conexión, esté esperando o jugando. Si estaba en una partida, la partida termina.
+ */
+void Matchmaker::remove(Connection *connection)
+{
+    waiting.remove(connection);
+    quint32 sessionId = sessionByConnection.value(connection);
+    if (sessionId)
+        endSession(sessionId);
+}
+
+bool Matchmaker::isWaiting(Connection *connection) const
+{
+    return waiting.contains(connection);
+}
+
+int Matchmaker::waitingCount() const
+{
+    return waiting.size();
+}
+
+/*!
+ * Registra una partida nueva y regresa su identificador (nunca 0).
+ */
+quint32 Matchmaker::startSession(Connection *first, Connection *second)
+{
+    if (++lastSessionId == 0)
+        ++lastSessionId;
+
+    Session session;
+    session.players[0] = first;
+    session.players[1] = second;
+    sessions.insert(lastSessionId, session);
+    for (int i = 0; i < 2; ++i) {
+        if (session.players[i]) {
+            waiting.remove(session.players[i]);
+            sessionByConnection.insert(session.players[i], lastSessionId);
+        }
+    }
+    return lastSessionId;
+}
+
+void Matchmaker::endSession(quint32 sessionId)
+{
+    QHash<quint32, Session>::iterator it = sessions.find(sessionId);
+    if (it == sessions.end())
+        return;
+
+    for (int i = 0; i < 2; ++i) {
+        if (it->players[i])
+            sessionByConnection.remove(it->players[i]);
+    }
+    sessions.erase(it);
+}
+
+/*!
+ * Identificador de la partida en la que juega la conexión, o 0 si no está jugando.
+ */
+quint32 Matchmaker::sessionOf(Connection *connection) const
+{
+    return sessionByConnection.value(connection);
+}
+
+/*!
+ * Conexión del oponente; 0 si no hay partida o si el oponente es el nodo local.
+ */
+Connection *Matchmaker::opponentOf(Connection *connection) const
+{
+    QHash<quint32, Session>::const_iterator it = sessions.constFind(sessionOf(connection));
+    if (it == sessions.constEnd())
+        return 0;
+    return it->players[0] == connection ? it->players[1] : it->players[0];
+}
+
+int Matchmaker::sessionCount() const
+{
+    return sessions.size();
+}
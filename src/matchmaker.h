@@ -0,0 +1,46 @@
+#ifndef MATCHMAKER_H
+#define MATCHMAKER_H
+
+#include <QHash>
+#include <QQueue>
+#include <QSet>
+
+class Connection;
+
+/*
+ * Cola de espera de jugadores y registro de partidas. Emparejar y sacar de la
+ * cola son O(1): las conexiones que se van mientras esperan solo se borran del
+ * conjunto de espera y la cola las descarta al llegar a ellas.
+ * Cada partida tiene un identificador explícito; en el cliente gráfico el segundo
+ * jugador es el propio nodo y se representa con una conexión nula.
+ */
+class Matchmaker
+{
+public:
+    Matchmaker();
+
+    void enqueue(Connection *connection);
+    Connection *takeNext();
+    void remove(Connection *connection);
+    bool isWaiting(Connection *connection) const;
+    int waitingCount() const;
+
+    quint32 startSession(Connection *first, Connection *second = 0);
+    void endSession(quint32 sessionId);
+    quint32 sessionOf(Connection *connection) const;
+    Connection *opponentOf(Connection *connection) const;
+    int sessionCount() const;
+
+private:
+    struct Session {
+        Connection *players[2];
+    };
+
+    QQueue<Connection *> queue;
+    QSet<Connection *> waiting;
+    QHash<quint32, Session> sessions;
+    QHash<Connection *, quint32> sessionByConnection;
+    quint32 lastSessionId;
+};
+
+#endif
@@ -0,0 +1,227 @@
+#include "metrics.h"
+
+#include <QFile>
+#include <QList>
+#include <QMutex>
+#include <QMutexLocker>
+#include <QThreadStorage>
+
+#ifdef Q_OS_UNIX
+#include <unistd.h>
+#endif
+
+/*
+ * Bloque de contadores de un hilo. Solo el hilo dueño escribe, por eso sumar es
+ * leer y guardar con orden relajado; los atómicos solo evitan que un lector vea
+ * valores a medias.
+ */
+class Metrics::Shard
+{
+public:
+    Shard();
+    ~Shard();
+
+    void add(int counter, quint64 amount)
+    {
+        values[counter].store(values[counter].load(std::memory_order_relaxed) + amount,
+                              std::memory_order_relaxed);
+    }
+
+    std::atomic<quint64> values[CounterCount];
+};
+
+/*
+ * Registro de los bloques vivos y de las cuentas de los hilos que ya terminaron.
+ * Nunca se destruye: los bloques de los últimos hilos se entregan al salir del programa.
+ */
+struct MetricsRegistry
+{
+    MetricsRegistry() : retired(Metrics::CounterCount, 0) {}
+
+    QMutex mutex;
+    QList<Metrics::Shard *> shards;
+    QVector<quint64> retired;
+};
+
+static MetricsRegistry *registry()
+{
+    static MetricsRegistry *instance = new MetricsRegistry;
+    return instance;
+}
+
+static QThreadStorage<Metrics::Shard *> shards;
+
+Metrics::Shard::Shard()
+{
+    for (int i = 0; i < CounterCount; ++i)
+        values[i].store(0, std::memory_order_relaxed);
+
+    MetricsRegistry *r = registry();
+    QMutexLocker locker(&r->mutex);
+    r->shards.append(this);
+}
+
+/*!
+ * Corre al terminar el hilo dueño; sus cuentas pasan al bloque común.
+ */
+Metrics::Shard::~Shard()
+{
+    MetricsRegistry *r = registry();
+    QMutexLocker locker(&r->mutex);
+    r->shards.removeOne(this);
+    for (int i = 0; i < CounterCount; ++i)
+        r->retired[i] += values[i].load(std::memory_order_relaxed);
+}
+
+/*!
+ * El bloque del hilo actual; se crea la primera vez que el hilo cuenta algo.
+ */
+Metrics::Shard *Metrics::localShard()
+{
+    if (!shards.hasLocalData())
+        shards.setLocalData(new Shard);
+    return shards.localData();
+}
+
+void Metrics::add(Counter counter, quint64 amount)
+{
+    localShard()->add(counter, amount);
+}
+
+/*!
+ * Una trama recibida del tipo indicado; solo se cuentan los bytes de los datos,
+ * los bytes totales del socket van en BytesIn.
+ */
+void Metrics::frameIn(FrameScanner::DataType type, int payloadSize)
+{
+    if (type >= FrameScanner::Undefined)
+        return;
+    Shard *shard = localShard();
+    shard->add(FramesIn + type, 1);
+    shard->add(FrameBytesIn + type, payloadSize);
+}
+
+void Metrics::frameOut(FrameScanner::DataType type, int payloadSize)
+{
+    if (type >= FrameScanner::Undefined)
+        return;
+    Shard *shard = localShard();
+    shard->add(FramesOut + type, 1);
+    shard->add(FrameBytesOut + type, payloadSize);
+}
+
+/*!
+ * Suma de todos los hilos, vivos y terminados. Cada contador es exacto por
+ * separado, aunque entre dos contadores puede colarse una actualización.
+ */
+QVector<quint64> Metrics::snapshot()
+{
+    MetricsRegistry *r = registry();
+    QMutexLocker locker(&r->mutex);
+    QVector<quint64> totals = r->retired;
+    foreach (Shard *shard, r->shards) {
+        for (int i = 0; i < CounterCount; ++i)
+            totals[i] += shard->values[i].load(std::memory_order_relaxed);
+    }
+    return totals;
+}
+
+/*!
+ * Memoria residente del proceso en bytes, o 0 si el sistema no la reporta.
+ */
+qint64 Metrics::residentMemory()
+{
+#ifdef Q_OS_LINUX
+    QFile statm("/proc/self/statm");
+    if (statm.open(QIODevice::ReadOnly)) {
+        QList<QByteArray> fields = statm.readAll().split(' ');
+        if (fields.size() > 1)
+            return fields.at(1).toLongLong() * sysconf(_SC_PAGESIZE);
+    }
+#endif
+    return 0;
+}
+
+static const char *const counterNames[] = {
+    "gato_connections_opened_total",
+    "gato_connections_closed_total",
+    "gato_handshakes_total",
+    "gato_handshake_failures_total",
+    "gato_bytes_in_total",
+    "gato_bytes_out_total",
+    "gato_parse_errors_total",
+    "gato_buffer_overflow_aborts_total",
+    "gato_transfer_timeouts_total",
+    "gato_pong_timeouts_total",
+    "gato_discovery_datagrams_in_total",
+    "gato_discovery_datagrams_out_total",
+    "gato_games_started_total",
+    "gato_games_finished_total",
+    "gato_games_abandoned_total",
+    "gato_state_resyncs_total",
+    "gato_output_flushes_total",
+    "gato_journal_records_total",
+    "gato_journal_dropped_total",
+    "gato_sessions_suspended_total",
+    "gato_sessions_resumed_total"
+};
+
+static const char *const frameTypeNames[] = {
+    "message", "ping", "pong", "greeting", "state", "delta", "resync", "session"
+};
+
+static void appendValue(QByteArray *text, const char *name, quint64 value)
+{
+    *text += name;
+    *text += ' ';
+    *text += QByteArray::number(value);
+    *text += '\n';
+}
+
+static void appendFrameCounters(QByteArray *text, const char *name,
+                                const QVector<quint64> &totals, int first)
+{
+    *text += "# TYPE ";
+    *text += name;
+    *text += " counter\n";
+    for (int type = 0; type < FrameScanner::Undefined; ++type) {
+        *text += name;
+        *text += "{type=\"";
+        *text += frameTypeNames[type];
+        *text += "\"} ";
+        *text += QByteArray::number(totals.at(first + type));
+        *text += '\n';
+    }
+}
+
+/*!
+ * Formato de texto de Prometheus, ej. 'gato_frames_in_total{type="ping"} 12'.
+ */
+QByteArray Metrics::toText()
+{
+    const QVector<quint64> totals = snapshot();
+    QByteArray text;
+    text.reserve(2048);
+
+    text += "# TYPE gato_connections gauge\n";
+    appendValue(&text, "gato_connections",
+                totals.at(ConnectionsOpened) - totals.at(ConnectionsClosed));
+    text += "# TYPE gato_games_in_progress gauge\n";
+    const quint64 ended = totals.at(GamesFinished) + totals.at(GamesAbandoned);
+    appendValue(&text, "gato_games_in_progress",
+                totals.at(GamesStarted) - qMin(totals.at(GamesStarted), ended));
+    text += "# TYPE gato_resident_memory_bytes gauge\n";
+    appendValue(&text, "gato_resident_memory_bytes", residentMemory());
+
+    for (int i = 0; i < FramesIn; ++i) {
+        text += "# TYPE ";
+        text += counterNames[i];
+        text += " counter\n";
+        appendValue(&text, counterNames[i], totals.at(i));
+    }
+    appendFrameCounters(&text, "gato_frames_in_total", totals, FramesIn);
+    appendFrameCounters(&text, "gato_frames_out_total", totals, FramesOut);
+    appendFrameCounters(&text, "gato_frame_bytes_in_total", totals, FrameBytesIn);
+    appendFrameCounters(&text, "gato_frame_bytes_out_total", totals, FrameBytesOut);
+    return text;
+}
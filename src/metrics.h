@@ -0,0 +1,65 @@
+#ifndef METRICS_H
+#define METRICS_H
+
+#include <QByteArray>
+#include <QVector>
+
+#include <atomic>
+
+#include "framescanner.h"
+
+/*
+ * Contadores del proceso para observarlo en producción. Cada hilo suma en su
+ * propio bloque de contadores (solo él escribe, así que no hay contención ni
+ * instrucciones con candado) y quien lee suma los bloques de todos los hilos.
+ * Cuando un hilo termina, sus cuentas pasan a un bloque común para no perderlas.
+ * Los medidores (conexiones activas, partidas en curso) se calculan a partir de
+ * los contadores de altas y bajas.
+ */
+class Metrics
+{
+public:
+    enum Counter {
+        ConnectionsOpened,
+        ConnectionsClosed,
+        HandshakesCompleted,
+        HandshakesFailed,
+        BytesIn,
+        BytesOut,
+        ParseErrors,
+        BufferOverflowAborts,
+        TransferTimeouts,
+        PongTimeouts,
+        DatagramsIn,
+        DatagramsOut,
+        GamesStarted,
+        GamesFinished,
+        GamesAbandoned,
+        StateResyncs,
+        OutputFlushes,
+        JournalRecords,
+        JournalDropped,
+        SessionsSuspended,
+        SessionsResumed,
+        FramesIn,
+        FramesOut = FramesIn + FrameScanner::Undefined,
+        FrameBytesIn = FramesOut + FrameScanner::Undefined,
+        FrameBytesOut = FrameBytesIn + FrameScanner::Undefined,
+        CounterCount = FrameBytesOut + FrameScanner::Undefined
+    };
+
+    static void add(Counter counter, quint64 amount = 1);
+    static void frameIn(FrameScanner::DataType type, int payloadSize);
+    static void frameOut(FrameScanner::DataType type, int payloadSize);
+
+    static QVector<quint64> snapshot();
+    static QByteArray toText();
+    static qint64 residentMemory();
+
+    class Shard;
+
+private:
+    static Shard *localShard();
+};
+
+#endif
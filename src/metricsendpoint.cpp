@@ -0,0 +1,136 @@
+#include "metricsendpoint.h"
+#include "metrics.h"
+
+#include <QDateTime>
+#include <QFile>
+#include <QTcpSocket>
+
+#if QT_VERSION >= 0x050100
+#include <QSaveFile>
+#endif
+
+MetricsEndpoint::MetricsEndpoint(QObject *parent)
+    : QObject(parent)
+{
+    connect(&server, SIGNAL(newConnection()), this, SLOT(acceptConnection()));
+    connect(&dumpTimer, SIGNAL(timeout()), this, SLOT(dump()));
+}
+
+/*!
+ * Crea el punto de consulta según las variables de entorno, o regresa 0 si no
+ * se pidió ninguna de las dos salidas.
+ */
+MetricsEndpoint *MetricsEndpoint::fromEnvironment(QObject *parent)
+{
+    bool ok;
+    const int port = qgetenv("GATO_METRICS_PORT").toInt(&ok);
+    const bool usePort = ok && port > 0 && port <= 0xffff;
+    const QString fileName = QString::fromLocal8Bit(qgetenv("GATO_METRICS_FILE"));
+    if (!usePort && fileName.isEmpty())
+        return 0;
+
+    MetricsEndpoint *endpoint = new MetricsEndpoint(parent);
+    if (usePort && !endpoint->listen(port))
+        qWarning("No se pudo publicar las métricas en el puerto %d", port);
+    if (!fileName.isEmpty()) {
+        int interval = qgetenv("GATO_METRICS_INTERVAL").toInt(&ok) * 1000;
+        endpoint->startDump(fileName, ok && interval > 0 ? interval : DefaultDumpInterval);
+    }
+    return endpoint;
+}
+
+/*!
+ * Escucha solo en 127.0.0.1: las métricas no se exponen a la red.
+ */
+bool MetricsEndpoint::listen(quint16 port)
+{
+    return server.listen(QHostAddress::LocalHost, port);
+}
+
+bool MetricsEndpoint::isListening() const
+{
+    return server.isListening();
+}
+
+quint16 MetricsEndpoint::serverPort() const
+{
+    return server.serverPort();
+}
+
+/*!
+ * Escribe las métricas a fileName cada interval ms, además de una vez ahora.
+ */
+void MetricsEndpoint::startDump(const QString &fileName, int interval)
+{
+    dumpFileName = fileName;
+    dump();
+    dumpTimer.start(interval);
+}
+
+/*!
+ * Reemplaza el archivo completo, así quien lo lee nunca ve uno a medias.
+ */
+bool MetricsEndpoint::dump()
+{
+    if (dumpFileName.isEmpty())
+        return false;
+
+    QByteArray text = "# " + QDateTime::currentDateTime().toString(Qt::ISODate).toLatin1()
+                      + '\n' + Metrics::toText();
+#if QT_VERSION >= 0x050100
+    QSaveFile file(dumpFileName);
+    if (!file.open(QIODevice::WriteOnly) || file.write(text) != text.size())
+        return false;
+    return file.commit();
+#else
+    const QString temporary = dumpFileName + ".tmp";
+    QFile file(temporary);
+    if (!file.open(QIODevice::WriteOnly) || file.write(text) != text.size())
+        return false;
+    file.close();
+    QFile::remove(dumpFileName);
+    return QFile::rename(temporary, dumpFileName);
+#endif
+}
+
+void MetricsEndpoint::acceptConnection()
+{
+    while (QTcpSocket *socket = server.nextPendingConnection()) {
+        connect(socket, SIGNAL(readyRead()), this, SLOT(readRequest()));
+        connect(socket, SIGNAL(disconnected()), socket, SLOT(deleteLater()));
+    }
+}
+
+/*!
+ * Contesta 'GET /metrics' (o 'GET /') con las métricas en texto y cierra la conexión.
+ */
+void MetricsEndpoint::readRequest()
+{
+    QTcpSocket *socket = qobject_cast<QTcpSocket *>(sender());
+    if (!socket)
+        return;
+
+    if (!socket->canReadLine()) {
+        if (socket->bytesAvailable() > MaxRequestSize)
+            socket->abort();
+        return;
+    }
+
+    const QList<QByteArray> request = socket->readLine(MaxRequestSize).trimmed().split(' ');
+    socket->readAll();
+    socket->disconnect(this);
+
+    QByteArray response;
+    if (request.size() >= 2 && request.at(0) == "GET"
+            && (request.at(1) == "/metrics" || request.at(1) == "/")) {
+        const QByteArray body = Metrics::toText();
+        response = "HTTP/1.0 200 OK\r\n"
+                   "Content-Type: text/plain; version=0.0.4\r\n"
+                   "Content-Length: " + QByteArray::number(body.size()) + "\r\n"
+                   "Connection: close\r\n\r\n" + body;
+    } else {
+        response = "HTTP/1.0 404 Not Found\r\nContent-Length: 0\r\nConnection: close\r\n\r\n";
+    }
+    socket->write(response);
+    socket->disconnectFromHost();
+}
@@ -0,0 +1,45 @@
+#ifndef METRICSENDPOINT_H
+#define METRICSENDPOINT_H
+
+#include <QObject>
+#include <QString>
+#include <QTcpServer>
+#include <QTimer>
+
+/*
+ * Publica los contadores de Metrics: por HTTP, solo en la interfaz local
+ * (ej. 'curl http://127.0.0.1:9100/metrics'), y/o escribiéndolos
+ * periódicamente a un archivo. Se configura con las variables de entorno
+ * GATO_METRICS_PORT, GATO_METRICS_FILE y GATO_METRICS_INTERVAL (segundos).
+ */
+class MetricsEndpoint : public QObject
+{
+    Q_OBJECT
+
+public:
+    static const int DefaultDumpInterval = 10 * 1000;
+    static const int MaxRequestSize = 4096;
+
+    MetricsEndpoint(QObject *parent = 0);
+
+    static MetricsEndpoint *fromEnvironment(QObject *parent = 0);
+
+    bool listen(quint16 port);
+    bool isListening() const;
+    quint16 serverPort() const;
+    void startDump(const QString &fileName, int interval = DefaultDumpInterval);
+
+public slots:
+    bool dump();
+
+private slots:
+    void acceptConnection();
+    void readRequest();
+
+private:
+    QTcpServer server;
+    QTimer dumpTimer;
+    QString dumpFileName;
+};
+
+#endif
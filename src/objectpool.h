@@ -0,0 +1,105 @@
+#ifndef OBJECTPOOL_H
+#define OBJECTPOOL_H
+
+#include <QMutex>
+#include <QMutexLocker>
+
+#include <new>
+#include <stddef.h>
+
+/*
+ * Memoria para objetos de tipo T que se crean y destruyen muy seguido (una
+ * conexión por cliente, una partida por pareja). Se reserva en bloques de
+ * ChunkSize objetos y los lugares libres se encadenan en una lista, así crear
+ * uno es sacar de la lista y no una llamada a malloc con su cabecera propia.
+ * Los bloques no se devuelven al sistema: el pool queda del tamaño del pico.
+ * Se usa desde operator new/delete de la clase; las clases derivadas más
+ * grandes que T usan el operator new normal.
+ */
+template <typename T, int ChunkSize = 64>
+class ObjectPool
+{
+public:
+    static void *allocate(size_t size)
+    {
+        if (size != sizeof(T))
+            return ::operator new(size);
+
+        Storage &s = storage();
+        QMutexLocker locker(&s.mutex);
+        if (!s.free) {
+            char *chunk = static_cast<char *>(::operator new(SlotSize * ChunkSize));
+            for (int i = ChunkSize - 1; i >= 0; --i) {
+                Slot *slot = reinterpret_cast<Slot *>(chunk + i * SlotSize);
+                slot->next = s.free;
+                s.free = slot;
+            }
+            s.capacity += ChunkSize;
+        }
+        Slot *slot = s.free;
+        s.free = slot->next;
+        ++s.used;
+        return slot;
+    }
+
+    static void release(void *pointer, size_t size)
+    {
+        if (!pointer)
+            return;
+        if (size != sizeof(T)) {
+            ::operator delete(pointer);
+            return;
+        }
+
+        Storage &s = storage();
+        QMutexLocker locker(&s.mutex);
+        Slot *slot = static_cast<Slot *>(pointer);
+        slot->next = s.free;
+        s.free = slot;
+        --s.used;
+    }
+
+    /* Objetos vivos y lugares reservados en total */
+    static int usedCount()
+    {
+        Storage &s = storage();
+        QMutexLocker locker(&s.mutex);
+        return s.used;
+    }
+
+    static int capacity()
+    {
+        Storage &s = storage();
+        QMutexLocker locker(&s.mutex);
+        return s.capacity;
+    }
+
+private:
+    struct Slot {
+        Slot *next;
+    };
+
+    // Cada lugar respeta la alineación más estricta de los tipos básicos
+    enum {
+        Alignment = sizeof(long double) > sizeof(void *) ? sizeof(long double) : sizeof(void *),
+        SlotSize = (sizeof(T) + Alignment - 1) / Alignment * Alignment
+    };
+
+    struct Storage {
+        Storage() : free(0), used(0), capacity(0) {}
+
+        QMutex mutex;
+        Slot *free;
+        int used;
+        int capacity;
+    };
+
+    // Nunca se destruye, hay objetos que se liberan al salir del programa
+    static Storage &storage()
+    {
+        static Storage *instance = new Storage;
+        return *instance;
+    }
+};
+
+#endif
@@ -0,0 +1,66 @@
+#include "outgoingframe.h"
+
+OutgoingFrame::OutgoingFrame()
+{
+    type = FrameScanner::Undefined;
+    hash = 0;
+}
+
+/*!
+ * Mensaje de texto libre (MESSAGE).
+ */
+OutgoingFrame::OutgoingFrame(const QString &message)
+{
+    type = FrameScanner::PlainText;
+    hash = 0;
+    payload = message.toUtf8();
+    text = FrameScanner::textFrame(type, payload);
+}
+
+/*!
+ * Estado del juego: empaquetado para el protocolo binario y como texto para el anterior.
+ */
+OutgoingFrame::OutgoingFrame(const GameState &gameState)
+{
+    type = FrameScanner::PackedState;
+    state = gameState;
+    hash = gameState.hash();
+    payload = gameState.pack();
+    text = FrameScanner::textFrame(FrameScanner::PlainText, gameState.toText());
+}
+
+bool OutgoingFrame::isEmpty() const
+{
+    return type == FrameScanner::Undefined;
+}
+
+FrameScanner::DataType OutgoingFrame::binaryType() const
+{
+    return type;
+}
+
+const QByteArray &OutgoingFrame::binaryPayload() const
+{
+    return payload;
+}
+
+/*!
+ * La trama completa del protocolo de texto.
+ */
+const QByteArray &OutgoingFrame::textFrame() const
+{
+    return text;
+}
+
+/*!
+ * El estado del juego que lleva el mensaje, si es uno.
+ */
+const GameState &OutgoingFrame::gameState() const
+{
+    return state;
+}
+
+quint32 OutgoingFrame::stateHash() const
+{
+    return hash;
+}
@@ -0,0 +1,40 @@
+#ifndef OUTGOINGFRAME_H
+#define OUTGOINGFRAME_H
+
+#include <QByteArray>
+#include <QString>
+
+#include "framescanner.h"
+#include "gamestate.h"
+
+/*
+ * Mensaje ya codificado para mandarse a varias conexiones. Se codifica una sola
+ * vez para cada protocolo y los bytes se comparten implícitamente entre todas las
+ * conexiones que lo escriben. Con el protocolo binario solo la cabecera de 8 bytes
+ * (que lleva el número de secuencia de cada conexión) se arma por destinatario.
+ * Un estado del juego siempre va completo; cada conexión lo toma como la nueva
+ * base para sus jugadas siguientes.
+ */
+class OutgoingFrame
+{
+public:
+    OutgoingFrame();
+    explicit OutgoingFrame(const QString &message);
+    explicit OutgoingFrame(const GameState &gameState);
+
+    bool isEmpty() const;
+    FrameScanner::DataType binaryType() const;
+    const QByteArray &binaryPayload() const;
+    const QByteArray &textFrame() const;
+    const GameState &gameState() const;
+    quint32 stateHash() const;
+
+private:
+    FrameScanner::DataType type;
+    GameState state;
+    quint32 hash;
+    QByteArray payload;
+    QByteArray text;
+};
+
+#endif
@@ -0,0 +1,133 @@
+#include "peerdirectory.h"
+
+#include <algorithm>
+
+static const int MinRetryDelay = 1000;
+static const int MaxRetryDelay = 60 * 1000;
+
+PeerDirectory::PeerDirectory()
+{
+}
+
+/*!
+ * Agrega un nodo de la lista estática, para redes donde la difusión está bloqueada.
+ * No caduca y se considera siempre buscando partida.
+ */
+void PeerDirectory::addStatic(const QHostAddress &address, quint16 port)
+{
+    Peer peer;
+    peer.address = address;
+    peer.port = port;
+    peer.id = 0;
+    peer.lastSeen = 0;
+    peer.retryAt = 0;
+    peer.rtt = -1;
+    peer.failures = 0;
+    peer.seeking = true;
+    peer.isStatic = true;
+    peers.insert(Key(address, port), peer);
+}
+
+/*!
+ * Registra un anuncio recibido; id es 0 en los anuncios de versiones anteriores.
+ */
+void PeerDirectory::seen(const QHostAddress &address, quint16 port, const QByteArray &name,
+                         bool seeking, quint32 id, qint64 now)
+{
+    QHash<Key, Peer>::iterator it = peers.find(Key(address, port));
+    if (it == peers.end()) {
+        Peer peer;
+        peer.address = address;
+        peer.port = port;
+        peer.retryAt = 0;
+        peer.rtt = -1;
+        peer.failures = 0;
+        peer.isStatic = false;
+        it = peers.insert(Key(address, port), peer);
+    }
+    it->name = name;
+    it->id = id;
+    it->lastSeen = now;
+    it->seeking = seeking;
+}
+
+void PeerDirectory::connectSucceeded(const QHostAddress &address, quint16 port, int rtt)
+{
+    QHash<Key, Peer>::iterator it = peers.find(Key(address, port));
+    if (it == peers.end())
+        return;
+    it->rtt = rtt;
+    it->failures = 0;
+    it->retryAt = 0;
+}
+
+/*!
+ * Cada fallo seguido duplica el tiempo de espera antes de volver a intentar.
+ */
+void PeerDirectory::connectFailed(const QHostAddress &address, quint16 port, qint64 now)
+{
+    QHash<Key, Peer>::iterator it = peers.find(Key(address, port));
+    if (it == peers.end())
+        return;
+    const int shift = qMin(it->failures, 6);
+    it->retryAt = now + qMin(MinRetryDelay << shift, MaxRetryDelay);
+    ++it->failures;
+}
+
+static bool fasterPeer(const PeerDirectory::Peer &a, const PeerDirectory::Peer &b)
+{
+    if (a.rtt < 0 || b.rtt < 0)
+        return a.rtt >= 0 && b.rtt < 0;
+    return a.rtt < b.rtt;
+}
+
+/*!
+ * Nodos a los que conviene intentar conectarse ahora: buscando partida, vigentes y
+ * sin espera pendiente por fallos. Van primero los de menor tiempo de conexión
+ * medido y al final los que aún no se han medido.
+ */
+QList<PeerDirectory::Peer> PeerDirectory::candidates(qint64 now) const
+{
+    QList<Peer> list;
+    QHash<Key, Peer>::const_iterator it = peers.constBegin();
+    for (; it != peers.constEnd(); ++it) {
+        if (!it->seeking || it->retryAt > now)
+            continue;
+        if (!it->isStatic && now - it->lastSeen > Ttl)
+            continue;
+        list << it.value();
+    }
+    std::stable_sort(list.begin(), list.end(), fasterPeer);
+    return list;
+}
+
+const PeerDirectory::Peer *PeerDirectory::peer(const QHostAddress &address, quint16 port) const
+{
+    QHash<Key, Peer>::const_iterator it = peers.constFind(Key(address, port));
+    return it == peers.constEnd() ? 0 : &it.value();
+}
+
+bool PeerDirectory::isStatic(const QHostAddress &address, quint16 port) const
+{
+    const Peer *entry = peer(address, port);
+    return entry && entry->isStatic;
+}
+
+/*!
+ * Olvida los nodos que no se han anunciado en Ttl ms.
+ */
+void PeerDirectory::expire(qint64 now)
+{
+    QHash<Key, Peer>::iterator it = peers.begin();
+    while (it != peers.end()) {
+        if (!it->isStatic && now - it->lastSeen > Ttl)
+            it = peers.erase(it);
+        else
+            ++it;
+    }
+}
+
+int PeerDirectory::size() const
+{
+    return peers.size();
+}
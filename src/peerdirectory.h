@@ -0,0 +1,54 @@
+#ifndef PEERDIRECTORY_H
+#define PEERDIRECTORY_H
+
+#include <QByteArray>
+#include <QHash>
+#include <QHostAddress>
+#include <QList>
+#include <QPair>
+
+/*
+ * Directorio de nodos conocidos, indexado por (dirección, puerto del servidor).
+ * Guarda cuándo se vio cada nodo por última vez, el tiempo de conexión medido y
+ * los fallos recientes, para poder conectarse de inmediato a un nodo ya conocido
+ * en lugar de esperar al siguiente anuncio. Las entradas caducan tras Ttl ms sin
+ * anuncios, salvo las de la lista estática.
+ */
+class PeerDirectory
+{
+public:
+    typedef QPair<QHostAddress, quint16> Key;
+
+    struct Peer {
+        QHostAddress address;
+        quint16 port;
+        QByteArray name;
+        quint32 id;     // identificador de la instancia, 0 si no se conoce
+        qint64 lastSeen;
+        qint64 retryAt;
+        int rtt;        // ms, -1 si no se ha medido
+        int failures;
+        bool seeking;
+        bool isStatic;
+    };
+
+    static const int Ttl = 120 * 1000;
+
+    PeerDirectory();
+
+    void addStatic(const QHostAddress &address, quint16 port);
+    void seen(const QHostAddress &address, quint16 port, const QByteArray &name,
+              bool seeking, quint32 id, qint64 now);
+    void connectSucceeded(const QHostAddress &address, quint16 port, int rtt);
+    void connectFailed(const QHostAddress &address, quint16 port, qint64 now);
+    QList<Peer> candidates(qint64 now) const;
+    const Peer *peer(const QHostAddress &address, quint16 port) const;
+    bool isStatic(const QHostAddress &address, quint16 port) const;
+    void expire(qint64 now);
+    int size() const;
+
+private:
+    QHash<Key, Peer> peers;
+};
+
+#endif
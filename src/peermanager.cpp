@@ -1,15 +1,27 @@
 #include "peermanager.h"
+#include "metrics.h"
 
 
-static const qint32 BroadcastInterval = 2000;
+static const int ConnectTimeout = 5000;
+static const quint16 DefaultStaticPort = 45001;
 static const unsigned broadcastPort = 45000;
 
+/*
+ * Identificador aleatorio de esta instancia: distingue nuestros propios anuncios
+ * y decide cuál de dos nodos que se buscan mutuamente inicia la conexión.
+ */
+static quint32 newInstanceId()
+{
+    qsrand(uint(QDateTime::currentMSecsSinceEpoch()) ^ uint(QCoreApplication::applicationPid()));
+    return (quint32(qrand()) << 16) ^ quint32(qrand());
+}
+
 /*
  * El constructor recibe una instancia de la clase cliente
 */
 
 PeerManager::PeerManager(Client *client)
-    : QObject(client)
+    : QObject(client), schedule(newInstanceId())
 {
     this->client = client;
 
@@ -37,6 +49,34 @@ PeerManager::PeerManager(Client *client)
 
     updateAddresses();
     serverPort = 0;
+    announcementSeq = 0;
+    sentCount = 0;
+    receivedCount = 0;
+    attemptCount = 0;
+    pendingPort = 0;
+    clock.start();
+
+/*
+  Lista estática de nodos (o de un servidor dedicado) para redes donde la difusión
+  está bloqueada: GATO_PEERS="ip:puerto,ip:puerto". Sin puerto se usa el del servidor dedicado.
+*/
+    // Las entradas vacías se saltan a mano: QString::SkipEmptyParts es obsoleto desde Qt 5.14
+    foreach (const QString &item, QString::fromLocal8Bit(qgetenv("GATO_PEERS")).split(',')) {
+        const QString entry = item.trimmed();
+        if (entry.isEmpty())
+            continue;
+        QStringList parts = entry.split(':');
+        QHostAddress address;
+        if (!address.setAddress(parts.at(0))) {
+            QList<QHostAddress> resolved = QHostInfo::fromName(parts.at(0)).addresses();
+            if (resolved.isEmpty())
+                continue;
+            address = resolved.first();
+        }
+        quint16 port = parts.size() > 1 ? parts.at(1).toUShort() : DefaultStaticPort;
+        if (port)
+            directory.addStatic(address, port);
+    }
 
     broadcastSocket.bind(QHostAddress::Any, broadcastPort, QUdpSocket::ShareAddress
                          | QUdpSocket::ReuseAddressHint);
@@ -44,11 +84,24 @@ PeerManager::PeerManager(Client *client)
             this, SLOT(readBroadcastDatagram()));
 
 /*
-  Comienza un timmer que va a conectar el slot que va a difundir el datagrama a la red cada 2 segundos
+  Si la variable de entorno GATO_MULTICAST tiene una dirección de grupo (ej. 239.255.43.21)
+  los anuncios van a ese grupo en lugar de a las direcciones de difusión de cada subred.
 */
-    broadcastTimer.setInterval(BroadcastInterval);
+    QByteArray group = qgetenv("GATO_MULTICAST");
+    if (!group.isEmpty() && multicastGroup.setAddress(QString::fromLatin1(group))
+            && broadcastSocket.joinMulticastGroup(multicastGroup)) {
+        broadcastSocket.setSocketOption(QAbstractSocket::MulticastTtlOption, 1);
+    } else {
+        multicastGroup.clear();
+    }
+
+/*
+  Temporizador de un solo disparo: el intervalo entre anuncios crece al doble cada
+  vez (hasta DiscoverySchedule::MaxInterval) mientras nada cambie.
+*/
+    broadcastTimer.setSingleShot(true);
     connect(&broadcastTimer, SIGNAL(timeout()),
-            this, SLOT(sendBroadcastDatagram()));
+            this, SLOT(announcementInterval()));
 }
 
 /*!
@@ -68,11 +121,73 @@ QByteArray PeerManager::userName() const
 }
 
 /*!
- * Comienza la emición del datagrama cada 2 segundo para que sea detectado por otra instancia
+ * Comienza la emición del datagrama para que sea detectado por otra instancia,
+ * y se intenta de inmediato con los nodos de la lista estática.
  */
 void PeerManager::startBroadcasting()
 {
-    broadcastTimer.start();
+    resetInterval();
+    connectToKnownPeer();
+}
+
+/*!
+ * Cambia el estado que anunciamos: buscando partida o jugando. Un cambio de
+ * estado se anuncia de inmediato y reinicia el intervalo al mínimo.
+ */
+void PeerManager::setSeeking(bool seeking)
+{
+    if (!schedule.setSeeking(seeking))
+        return;
+    if (!seeking && pendingConnection)
+        pendingConnection = 0;
+    resetInterval();
+
+    // Al quedar libres no se espera al siguiente anuncio si ya conocemos a alguien
+    if (seeking)
+        connectToKnownPeer();
+}
+
+quint64 PeerManager::datagramsSent() const
+{
+    return sentCount;
+}
+
+quint64 PeerManager::datagramsReceived() const
+{
+    return receivedCount;
+}
+
+quint64 PeerManager::connectAttempts() const
+{
+    return attemptCount;
+}
+
+/*!
+ * Anuncia ya y vuelve al intervalo mínimo.
+ */
+void PeerManager::resetInterval()
+{
+    schedule.reset();
+    sendBroadcastDatagram();
+    broadcastTimer.start(schedule.interval());
+}
+
+/*!
+ * Fin de un intervalo. El anuncio se suprime si no le sirve a nadie (ver
+ * DiscoverySchedule); luego el intervalo se duplica. Los nodos que dejaron de
+ * anunciarse se olvidan.
+ */
+void PeerManager::announcementInterval()
+{
+    if (schedule.endInterval())
+        sendBroadcastDatagram();
+
+    const qint64 now = clock.elapsed();
+    directory.expire(now);
+    schedule.expire(now);
+    connectToKnownPeer();
+
+    broadcastTimer.start(schedule.interval());
 }
 
 /*!
@@ -89,9 +204,10 @@ bool PeerManager::isLocalHostAddress(const QHostAddress &address)
 }
 
 /*!
- * Genera un datagrama válido para la aplicación en el formato usuario@puerto y lo difunde en la red
- * con el fin de que otra instancia del programa la detecte con readBroadcastDatagram()
- * para poder estrablecer la conexión entre los nodos.
+ * Genera un datagrama válido para la aplicación en el formato usuario@puerto@estado@id@secuencia
+ * y lo difunde en la red con el fin de que otra instancia del programa la detecte con
+ * readBroadcastDatagram() para poder estrablecer la conexión entre los nodos.
+ * El estado es 'S' si buscamos partida y 'B' si ya estamos jugando.
  */
 
 void PeerManager::sendBroadcastDatagram()
@@ -99,12 +215,30 @@ void PeerManager::sendBroadcastDatagram()
     QByteArray datagram(username);
     datagram.append('@');
     datagram.append(QByteArray::number(serverPort));
+    datagram.append('@');
+    datagram.append(schedule.isSeeking() ? 'S' : 'B');
+    datagram.append('@');
+    datagram.append(QByteArray::number(schedule.id(), 16));
+    datagram.append('@');
+    datagram.append(QByteArray::number(++announcementSeq));
+
+    if (!multicastGroup.isNull()) {
+        if (broadcastSocket.writeDatagram(datagram, multicastGroup, broadcastPort) != -1) {
+            ++sentCount;
+            Metrics::add(Metrics::DatagramsOut);
+        }
+        return;
+    }
 
     bool validBroadcastAddresses = true;
     foreach (QHostAddress address, broadcastAddresses) {
         if (broadcastSocket.writeDatagram(datagram, address,
                                           broadcastPort) == -1)
             validBroadcastAddresses = false;
+        else {
+            ++sentCount;
+            Metrics::add(Metrics::DatagramsOut);
+        }
     }
 
     if (!validBroadcastAddresses)
@@ -113,7 +247,8 @@ void PeerManager::sendBroadcastDatagram()
 
 /*!
  * Lee la emisión de datagramas (usuario/ip + puerto) en la red y comprueba si es tiene el formato
- * que lo identifica como un nodo de este progrma
+ * que lo identifica como un nodo de este progrma. También entiende el formato usuario@puerto
+ * de versiones anteriores, que se tratan como nodos buscando partida.
  */
 void PeerManager::readBroadcastDatagram()
 {
@@ -127,9 +262,13 @@ void PeerManager::readBroadcastDatagram()
         if (broadcastSocket.readDatagram(datagram.data(), datagram.size(),
                                          &senderIp, &senderPort) == -1)
             continue;
-        // Comprueba que el datagrama tenga el formato usuario@puerto para saber si es un nodo de esta aplicación.
+        ++receivedCount;
+        Metrics::add(Metrics::DatagramsIn);
+
+        // Comprueba que el datagrama tenga el formato usuario@puerto[@estado@id@secuencia]
+        // para saber si es un nodo de esta aplicación.
         QList<QByteArray> list = datagram.split('@');
-        if (list.size() != 2)
+        if (list.size() != 2 && list.size() != 5)
             continue;
 
         //Que no sea esta instancia
@@ -137,16 +276,121 @@ void PeerManager::readBroadcastDatagram()
         if (isLocalHostAddress(senderIp) && senderServerPort == serverPort)
             continue;
 
-        // Una vez comprobado que es un nodo de este programa, se crea la conexión con él
-        // y se emite la señal de nueva conexión y se detiene la búsqueda de otros jugadores
-        if (!client->hasConnection(senderIp)) {
-            Connection *connection = new Connection(this);
-            emit newConnection(connection);
-            connection->connectToHost(senderIp, senderServerPort);
+        bool senderSeeking = list.size() == 2 || list.at(2) == "S";
+        quint32 senderId = 0;
+        if (list.size() == 5) {
+            bool ok;
+            senderId = list.at(3).toUInt(&ok, 16);
+            if (!ok)
+                continue;
         }
+        if (senderServerPort > 0)
+            directory.seen(senderIp, senderServerPort, list.at(0), senderSeeking, senderId,
+                           clock.elapsed());
+
+        if (list.size() == 5) {
+            quint32 seq = list.at(4).toUInt();
+            const int reaction = schedule.heard(senderId, seq, senderSeeking, clock.elapsed());
+            if (reaction & DiscoverySchedule::AnnounceNow)
+                resetInterval();
+            if (!(reaction & DiscoverySchedule::Dial))
+                continue;
+        }
+
+        tryConnect(senderIp, senderServerPort);
     }
 }
 
+/*!
+ * Se conecta al nodo más rápido del directorio que siga buscando partida,
+ * sin esperar a que se anuncie de nuevo. Con los nodos que anuncian su
+ * identificador se sigue la misma regla que con los anuncios: solo llama el de
+ * identificador menor, si no ambos se llamarían y las dos partidas se caerían.
+ */
+void PeerManager::connectToKnownPeer()
+{
+    if (!schedule.isSeeking() || client->isPlaying() || pendingConnection)
+        return;
+
+    foreach (const PeerDirectory::Peer &peer, directory.candidates(clock.elapsed())) {
+        if (peer.id && !schedule.dialsFirst(peer.id))
+            continue;
+        if (!client->hasConnection(peer.address, peer.port)) {
+            tryConnect(peer.address, peer.port);
+            return;
+        }
+    }
+}
+
+/*!
+ * Una vez comprobado que es un nodo de este programa, se crea la conexión con él
+ * y se emite la señal de nueva conexión. Solo si aún no tenemos partida y no hay
+ * otro intento en curso: cualquier intento exitoso termina en partida.
+ */
+void PeerManager::tryConnect(const QHostAddress &address, int port)
+{
+    if (!schedule.isSeeking() || client->isPlaying() || pendingConnection
+            || client->hasConnection(address, port))
+        return;
+
+    Connection *connection = new Connection(this);
+    pendingConnection = connection;
+    pendingAddress = address;
+    pendingPort = port;
+    pendingClock.start();
+    ++attemptCount;
+    connect(connection, SIGNAL(readyForUse()), this, SLOT(connectAttemptSucceeded()));
+    connect(connection, SIGNAL(disconnected()), this, SLOT(connectAttemptFailed()));
+    connect(connection, SIGNAL(error(QAbstractSocket::SocketError)),
+            this, SLOT(connectAttemptFailed()));
+    emit newConnection(connection);
+    connection->connectToHost(address, port);
+
+    // Un servidor dedicado puede tardar en contestar el saludo hasta encontrar oponente
+    if (!directory.isStatic(address, port))
+        QTimer::singleShot(ConnectTimeout, this, SLOT(connectAttemptTimedOut()));
+}
+
+/*!
+ * El saludo se completó: el tiempo que tardó sirve para preferir a este nodo después.
+ */
+void PeerManager::connectAttemptSucceeded()
+{
+    if (sender() != pendingConnection)
+        return;
+    pendingConnection->disconnect(this);
+    pendingConnection = 0;
+    directory.connectSucceeded(pendingAddress, pendingPort, int(pendingClock.elapsed()));
+}
+
+void PeerManager::connectAttemptFailed()
+{
+    if (sender() != pendingConnection)
+        return;
+    pendingConnection->disconnect(this);
+    pendingConnection = 0;
+    directory.connectFailed(pendingAddress, pendingPort, clock.elapsed());
+    connectToKnownPeer();
+}
+
+/*!
+ * El otro nodo no contestó el saludo a tiempo (probablemente ya está jugando).
+ */
+void PeerManager::connectAttemptTimedOut()
+{
+    if (!pendingConnection || pendingClock.elapsed() < ConnectTimeout
+            || directory.isStatic(pendingAddress, pendingPort))
+        return;
+
+    Connection *connection = pendingConnection;
+    pendingConnection = 0;
+    connection->disconnect(this);
+    connection->abort();
+    connection->deleteLater();
+    directory.connectFailed(pendingAddress, pendingPort, clock.elapsed());
+    connectToKnownPeer();
+}
+
 /*!
  * Actualiza la lista de ips y puertos disponibles en las distintas interfaces de red del equipo
  */
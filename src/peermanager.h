@@ -3,13 +3,18 @@
 
 #include <QtNetwork>
 #include <QByteArray>
+#include <QElapsedTimer>
 #include <QList>
+#include <QHash>
 #include <QObject>
+#include <QPointer>
 #include <QTimer>
 #include <QUdpSocket>
 
 #include "connection.h"
 #include "client.h"
+#include "discoveryschedule.h"
+#include "peerdirectory.h"
 
 class Client;
 
@@ -23,25 +28,49 @@ public:
     void setServerPort(int port);
     QByteArray userName() const;
     void startBroadcasting();
+    void setSeeking(bool seeking);
     bool isLocalHostAddress(const QHostAddress &address);
 
+    quint64 datagramsSent() const;
+    quint64 datagramsReceived() const;
+    quint64 connectAttempts() const;
+
 signals:
     void newConnection(Connection *connection);
 
 private slots:
-    void sendBroadcastDatagram();
+    void announcementInterval();
     void readBroadcastDatagram();
+    void connectAttemptSucceeded();
+    void connectAttemptFailed();
+    void connectAttemptTimedOut();
 
 private:
+    void sendBroadcastDatagram();
+    void resetInterval();
+    void connectToKnownPeer();
+    void tryConnect(const QHostAddress &address, int port);
     void updateAddresses();
 
     Client *client;
     QList<QHostAddress> broadcastAddresses;
     QList<QHostAddress> ipAddresses;
+    QHostAddress multicastGroup;
     QUdpSocket broadcastSocket;
     QTimer broadcastTimer;
     QByteArray username;
     int serverPort;
+    quint32 announcementSeq;
+    DiscoverySchedule schedule;
+    PeerDirectory directory;
+    QElapsedTimer clock;
+    QPointer<Connection> pendingConnection;
+    QHostAddress pendingAddress;
+    quint16 pendingPort;
+    QElapsedTimer pendingClock;
+    quint64 sentCount;
+    quint64 receivedCount;
+    quint64 attemptCount;
 };
 
 #endif
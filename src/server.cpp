@@ -1,5 +1,51 @@
 #include "server.h"
 
+ServerWorker::ServerWorker()
+    : connections(0)
+{
+}
+
+/*!
+ * Número de conexiones asignadas a este hilo, incluidas las que aún no acepta.
+ */
+int ServerWorker::load() const
+{
+    return connections.fetchAndAddRelaxed(0);
+}
+
+/*!
+ * El Server la llama desde su hilo al asignarle una conexión, para que una
+ * ráfaga de conexiones no caiga toda en el mismo hilo.
+ */
+void ServerWorker::reserve()
+{
+    connections.ref();
+}
+
+/*!
+ * Se ejecuta en el hilo del trabajador: la conexión y sus notificadores de
+ * socket quedan en este hilo. La señal se emite antes de volver al ciclo de
+ * eventos, así nadie pierde el saludo del otro nodo.
+ */
+void ServerWorker::acceptConnection(SocketDescriptor socketDescriptor)
+{
+    Connection *connection = new Connection(this);
+    if (!connection->setSocketDescriptor(socketDescriptor)) {
+        delete connection;
+        connections.deref();
+        return;
+    }
+
+    connect(connection, SIGNAL(destroyed()), this, SLOT(connectionDestroyed()),
+            Qt::DirectConnection);
+    emit newConnection(connection);
+}
+
+void ServerWorker::connectionDestroyed()
+{
+    connections.deref();
+}
+
 Server::Server(QObject *parent)
     : QTcpServer(parent)
 {
@@ -7,12 +53,86 @@ Server::Server(QObject *parent)
     listen(QHostAddress::Any);
 }
 
+/*! Igual que el anterior pero en un puerto fijo, para el servidor dedicado.
+ */
+Server::Server(quint16 port, QObject *parent)
+    : QTcpServer(parent)
+{
+    listen(QHostAddress::Any, port);
+}
+
+Server::~Server()
+{
+    stopWorkers();
+}
+
+/*!
+ * Reparte las conexiones entrantes entre count hilos, cada uno con su propio
+ * ciclo de eventos. Con 0 (el valor inicial) todo corre en el hilo del Server.
+ */
+void Server::setWorkerThreads(int count)
+{
+    stopWorkers();
+    if (count <= 0)
+        return;
+
+    qRegisterMetaType<Connection *>("Connection*");
+    qRegisterMetaType<SocketDescriptor>("SocketDescriptor");
+    qRegisterMetaType<GameState>("GameState");
+    qRegisterMetaType<QAbstractSocket::SocketError>("QAbstractSocket::SocketError");
+
+    for (int i = 0; i < count; ++i) {
+        QThread *thread = new QThread(this);
+        ServerWorker *worker = new ServerWorker;
+        worker->moveToThread(thread);
+        connect(thread, SIGNAL(finished()), worker, SLOT(deleteLater()));
+        connect(worker, SIGNAL(newConnection(Connection*)),
+                this, SIGNAL(newConnection(Connection*)), Qt::DirectConnection);
+        thread->start();
+        threads << thread;
+        workers << worker;
+    }
+}
+
+int Server::workerThreads() const
+{
+    return threads.size();
+}
+
+void Server::stopWorkers()
+{
+    foreach (QThread *thread, threads) {
+        thread->quit();
+        thread->wait();
+        delete thread;
+    }
+    threads.clear();
+    workers.clear();
+}
+
 /*! Conexión entrante, cada que una nueva conexión es detectada, se crea una instancia de la clase Conecction
  * Y se emite la señal de nueva conexión pasando como argumento la conexión recién detectada.
+ * Con hilos de trabajo, la conexión se crea en el hilo con menos conexiones.
  */
-void Server::incomingConnection(int socketDescriptor)
+void Server::incomingConnection(SocketDescriptor socketDescriptor)
 {
-    Connection *connection = new Connection(this);
-    connection->setSocketDescriptor(socketDescriptor);
-    emit newConnection(connection);
+    if (workers.isEmpty()) {
+        Connection *connection = new Connection(this);
+        connection->setSocketDescriptor(socketDescriptor);
+        emit newConnection(connection);
+        return;
+    }
+
+    ServerWorker *worker = workers.first();
+    int minLoad = worker->load();
+    for (int i = 1; i < workers.size() && minLoad > 0; ++i) {
+        int load = workers.at(i)->load();
+        if (load < minLoad) {
+            minLoad = load;
+            worker = workers.at(i);
+        }
+    }
+    worker->reserve();
+    QMetaObject::invokeMethod(worker, "acceptConnection", Qt::QueuedConnection,
+                              Q_ARG(SocketDescriptor, socketDescriptor));
 }
@@ -1,23 +1,74 @@
 #ifndef SERVER_H
 #define SERVER_H
 
+#include <QAtomicInt>
+#include <QList>
 #include <QTcpServer>
+#include <QThread>
 #include <QtNetwork>
 
 #include "connection.h"
 
+#if QT_VERSION >= 0x050000
+typedef qintptr SocketDescriptor;
+#else
+typedef int SocketDescriptor;
+#endif
+
+/*
+ * Hilo de trabajo del servidor: crea las conexiones que le asigna el Server, de
+ * modo que sus lecturas, el análisis de tramas y los pings corren en su propio
+ * ciclo de eventos y no en el hilo principal.
+ */
+class ServerWorker : public QObject
+{
+    Q_OBJECT
+
+public:
+    ServerWorker();
+
+    int load() const;
+    void reserve();
+
+signals:
+    void newConnection(Connection *connection);
+
+public slots:
+    void acceptConnection(SocketDescriptor socketDescriptor);
+
+private slots:
+    void connectionDestroyed();
+
+private:
+    mutable QAtomicInt connections;
+};
+
 class Server : public QTcpServer
 {
     Q_OBJECT
 
 public:
     Server(QObject *parent = 0);
+    Server(quint16 port, QObject *parent = 0);
+    ~Server();
+
+    void setWorkerThreads(int count);
+    int workerThreads() const;
 
 signals:
+    /* Con hilos de trabajo se emite desde el hilo de la conexión: quien la reciba
+     * debe conectarse con Qt::DirectConnection y solo hacer operaciones seguras
+     * entre hilos, para que esté listo antes de que lleguen datos. */
     void newConnection(Connection *connection);
 
 protected:
-    void incomingConnection(int socketDescriptor);
+    void incomingConnection(SocketDescriptor socketDescriptor);
+
+private:
+    void stopWorkers();
+
+    QList<QThread *> threads;
+    QList<ServerWorker *> workers;
 };
 
 #endif
@@ -0,0 +1,257 @@
+#include "solvedtable.h"
+
+namespace {
+
+const int Cells = 9;
+
+constexpr quint16 Lines[8] = {
+    0x007, 0x038, 0x1c0,    // filas
+    0x049, 0x092, 0x124,    // columnas
+    0x111, 0x054            // diagonales
+};
+
+/* Primero el centro, luego las esquinas y al final los lados */
+constexpr int MoveOrder[Cells] = { 4, 0, 2, 6, 8, 1, 3, 5, 7 };
+
+/*
+ * Formato de cada entrada:
+ * bits 0-4 puntaje + ScoreBias, bits 5-8 mejor jugada (NoMove si no hay),
+ * bits 9-12 índice de la línea ganadora (NoLine si no hay), bit 13 terminal,
+ * bit 14 posición válida. El puntaje es positivo si gana quien tiene el turno,
+ * y mayor mientras antes gane: 1 + casillas libres al terminar.
+ */
+const int ScoreBias = 16;
+const int ScoreMask = 0x1f;
+const int MoveShift = 5;
+const int LineShift = 9;
+const int FieldMask = 0xf;
+const int NoMove = 0xf;
+const int NoLine = 0xf;
+const int TerminalBit = 1 << 13;
+const int ValidBit = 1 << 14;
+
+struct Ternary { int values[1 << Cells]; };
+struct Table { quint16 entries[SolvedTable::Size]; };
+
+/* Valor en base 3 de una máscara de casillas con dígito 1 */
+constexpr Ternary makeTernary()
+{
+    Ternary t {};
+    for (int mask = 0; mask < (1 << Cells); ++mask) {
+        int value = 0;
+        int power = 1;
+        for (int i = 0; i < Cells; ++i) {
+            if (mask & (1 << i))
+                value += power;
+            power *= 3;
+        }
+        t.values[mask] = value;
+    }
+    return t;
+}
+
+constexpr Ternary ternary = makeTernary();
+
+constexpr int indexOf(quint16 cross, quint16 circle)
+{
+    return ternary.values[cross] + 2 * ternary.values[circle];
+}
+
+constexpr int popCount(quint16 bits)
+{
+    int count = 0;
+    for (; bits; bits &= bits - 1)
+        ++count;
+    return count;
+}
+
+constexpr int lineOf(quint16 marks)
+{
+    for (int i = 0; i < 8; ++i) {
+        if ((marks & Lines[i]) == Lines[i])
+            return i;
+    }
+    return -1;
+}
+
+constexpr int scoreOf(quint16 entry)
+{
+    return int(entry & ScoreMask) - ScoreBias;
+}
+
+/*
+ * Negamax completo con memoria: cada posición alcanzable se resuelve una sola
+ * vez y se guarda en la tabla.
+ */
+constexpr int solve(Table &t, quint16 cross, quint16 circle)
+{
+    const int index = indexOf(cross, circle);
+    if (t.entries[index] & ValidBit)
+        return scoreOf(t.entries[index]);
+
+    const bool crossToMove = popCount(cross) == popCount(circle);
+    const quint16 other = crossToMove ? circle : cross;
+    const quint16 empty = quint16(((1 << Cells) - 1) & ~(cross | circle));
+    const int line = lineOf(other);
+
+    int score = 0;
+    int move = NoMove;
+    bool terminal = true;
+    if (line >= 0) {
+        score = -(popCount(empty) + 1);
+    } else if (empty) {
+        terminal = false;
+        score = -ScoreBias;
+        for (int n = 0; n < Cells; ++n) {
+            const quint16 bit = quint16(1 << MoveOrder[n]);
+            if (!(empty & bit))
+                continue;
+            const int child = crossToMove ? -solve(t, cross | bit, circle)
+                                          : -solve(t, cross, circle | bit);
+            if (child > score) {
+                score = child;
+                move = MoveOrder[n];
+            }
+        }
+    }
+
+    t.entries[index] = quint16(ValidBit | (terminal ? TerminalBit : 0)
+                               | ((line < 0 ? NoLine : line) << LineShift)
+                               | (move << MoveShift) | (score + ScoreBias));
+    return score;
+}
+
+constexpr Table build()
+{
+    Table t {};
+    solve(t, 0, 0);
+    return t;
+}
+
+constexpr Table table = build();
+
+/*
+ * Comprobaciones en tiempo de compilación. bruteForce() es un minimax sin
+ * memoria ni orden de jugadas, independiente de solve(); consistent() revisa
+ * que cada entrada no terminal valga lo mismo que su mejor hija y que la
+ * mejor jugada guardada la alcance.
+ */
+constexpr int bruteForce(quint16 cross, quint16 circle)
+{
+    const bool crossToMove = popCount(cross) == popCount(circle);
+    const quint16 empty = quint16(((1 << Cells) - 1) & ~(cross | circle));
+    if (lineOf(crossToMove ? circle : cross) >= 0)
+        return -(popCount(empty) + 1);
+    if (!empty)
+        return 0;
+
+    int best = -ScoreBias;
+    for (int pos = 0; pos < Cells; ++pos) {
+        const quint16 bit = quint16(1 << pos);
+        if (empty & bit) {
+            const int child = crossToMove ? -bruteForce(cross | bit, circle)
+                                          : -bruteForce(cross, circle | bit);
+            best = child > best ? child : best;
+        }
+    }
+    return best;
+}
+
+constexpr bool matchesBruteForce(quint16 cross, quint16 circle)
+{
+    return (table.entries[indexOf(cross, circle)] & ValidBit)
+            && scoreOf(table.entries[indexOf(cross, circle)]) == bruteForce(cross, circle);
+}
+
+constexpr bool consistent()
+{
+    int valid = 0;
+    for (int cross = 0; cross < (1 << Cells); ++cross) {
+        for (int circle = 0; circle < (1 << Cells); ++circle) {
+            if (cross & circle)
+                continue;
+            const quint16 entry = table.entries[indexOf(cross, circle)];
+            if (!(entry & ValidBit))
+                continue;
+            ++valid;
+            if (entry & TerminalBit)
+                continue;
+
+            const bool crossToMove = popCount(cross) == popCount(circle);
+            const int move = (entry >> MoveShift) & FieldMask;
+            if (move >= Cells || ((cross | circle) & (1 << move)))
+                return false;
+            const quint16 bit = quint16(1 << move);
+            const quint16 child = crossToMove ? table.entries[indexOf(cross | bit, circle)]
+                                              : table.entries[indexOf(cross, circle | bit)];
+            if (!(child & ValidBit) || -scoreOf(child) != scoreOf(entry))
+                return false;
+        }
+    }
+    // Número conocido de posiciones alcanzables del gato
+    return valid == 5478;
+}
+
+static_assert(consistent(), "tabla resuelta inconsistente");
+static_assert(scoreOf(table.entries[0]) == 0, "el gato con juego perfecto es empate");
+static_assert(matchesBruteForce(0x010, 0x000), "X al centro");
+static_assert(matchesBruteForce(0x001, 0x010), "X en esquina, O al centro");
+static_assert(matchesBruteForce(0x002, 0x001), "X a un lado, O en esquina");
+static_assert(matchesBruteForce(0x011, 0x100), "O en la esquina equivocada");
+static_assert(matchesBruteForce(0x003, 0x018), "X amenaza ganar");
+
+} // namespace
+
+/*!
+ * Índice de la posición a partir de las máscaras de cada jugador.
+ */
+int SolvedTable::index(quint16 cross, quint16 circle)
+{
+    return indexOf(cross & 0x1ff, circle & 0x1ff & ~cross);
+}
+
+bool SolvedTable::isValid(int index)
+{
+    return table.entries[index] & ValidBit;
+}
+
+bool SolvedTable::isTerminal(int index)
+{
+    return table.entries[index] & TerminalBit;
+}
+
+/*!
+ * Resultado con juego perfecto para quien tiene el turno.
+ */
+SolvedTable::Value SolvedTable::value(int index)
+{
+    const int s = scoreOf(table.entries[index]);
+    return s > 0 ? Win : s < 0 ? Loss : Draw;
+}
+
+/*!
+ * Como value(), pero distingue qué tan pronto termina: 1 + casillas libres al final.
+ */
+int SolvedTable::score(int index)
+{
+    return scoreOf(table.entries[index]);
+}
+
+/*!
+ * Mejor jugada para quien tiene el turno, o -1 si la partida terminó o la
+ * posición no es alcanzable.
+ */
+int SolvedTable::bestMove(int index)
+{
+    const int move = (table.entries[index] >> MoveShift) & FieldMask;
+    return move == NoMove ? -1 : move;
+}
+
+/*!
+ * Máscara de la línea ganadora, o 0 si nadie ha ganado.
+ */
+quint16 SolvedTable::winningLine(int index)
+{
+    const int line = (table.entries[index] >> LineShift) & FieldMask;
+    return line == NoLine ? 0 : Lines[line];
+}
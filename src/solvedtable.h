@@ -0,0 +1,30 @@
+#ifndef SOLVEDTABLE_H
+#define SOLVEDTABLE_H
+
+#include <QtGlobal>
+
+/*
+ * El tablero de 3x3 resuelto en tiempo de compilación. Cada posición se indexa
+ * en base 3 (casilla i = dígito i: 0 vacía, 1 X, 2 O) y guarda en 16 bits el
+ * valor de la partida para quien tiene el turno, la mejor jugada, la línea
+ * ganadora y si la partida ya terminó. Solo tienen entrada las posiciones a las
+ * que se llega jugando desde el tablero vacío; las demás regresan isValid() false.
+ * Tiene el turno X si ambos llevan las mismas marcas.
+ */
+class SolvedTable
+{
+public:
+    enum Value { Loss = -1, Draw = 0, Win = 1 };
+
+    static const int Size = 19683; // 3^9
+
+    static int index(quint16 cross, quint16 circle);
+    static bool isValid(int index);
+    static bool isTerminal(int index);
+    static Value value(int index);
+    static int score(int index);
+    static int bestMove(int index);
+    static quint16 winningLine(int index);
+};
+
+#endif
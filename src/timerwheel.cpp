@@ -0,0 +1,198 @@
+#include "timerwheel.h"
+
+#include <QThreadStorage>
+#include <QTimerEvent>
+
+static QThreadStorage<TimerWheel *> wheels;
+
+TimerWheel::Entry::Entry()
+{
+    wheel = 0;
+    list = 0;
+    prev = 0;
+    next = 0;
+    rounds = 0;
+}
+
+TimerWheel::Entry::~Entry()
+{
+    if (wheel)
+        wheel->cancel(this);
+}
+
+bool TimerWheel::Entry::isScheduled() const
+{
+    return list != 0;
+}
+
+TimerWheel::TimerWheel()
+    : buckets(SlotCount, 0)
+{
+    expiring = 0;
+    processedTicks = 0;
+    current = 0;
+    count = 0;
+    timerId = 0;
+    clock.start();
+}
+
+/*!
+ * Al terminar el hilo se sueltan los elementos que sigan programados.
+ */
+TimerWheel::~TimerWheel()
+{
+    for (int i = 0; i < SlotCount; ++i) {
+        while (Entry *entry = buckets[i]) {
+            unlink(entry);
+            entry->wheel = 0;
+        }
+    }
+    while (Entry *entry = expiring) {
+        unlink(entry);
+        entry->wheel = 0;
+    }
+}
+
+/*!
+ * La rueda del hilo actual; se crea la primera vez que se pide.
+ */
+TimerWheel *TimerWheel::instance()
+{
+    if (!wheels.hasLocalData())
+        wheels.setLocalData(new TimerWheel);
+    return wheels.localData();
+}
+
+/*!
+ * Milisegundos desde que se creó la rueda, con un reloj monótono.
+ */
+qint64 TimerWheel::now() const
+{
+    return clock.elapsed();
+}
+
+/*!
+ * Programa el elemento para dentro de delay ms (redondeado hacia arriba a la
+ * resolución de la rueda). Si ya estaba programado se reprograma.
+ */
+void TimerWheel::schedule(Entry *entry, qint64 delay)
+{
+    if (entry->wheel && entry->wheel != this)
+        entry->wheel->cancel(entry);
+    else if (entry->list)
+        unlink(entry);
+
+    // Si la rueda estaba parada se alinea con el reloj para no recorrer casillas vacías
+    if (!count)
+        processedTicks = clock.elapsed() / Resolution;
+
+    // Los ticks se cuentan desde el último procesado, no desde ahora
+    qint64 ticks = (clock.elapsed() + qMax(delay, qint64(0)) + Resolution - 1) / Resolution
+                   - processedTicks;
+    if (ticks < 1)
+        ticks = 1;
+
+    entry->wheel = this;
+    entry->rounds = int((ticks - 1) / SlotCount);
+    link(entry, &buckets[(current + ticks) % SlotCount]);
+
+    if (!timerId)
+        timerId = startTimer(Resolution);
+}
+
+void TimerWheel::cancel(Entry *entry)
+{
+    if (entry->list)
+        unlink(entry);
+    entry->wheel = 0;
+
+    if (!count && timerId) {
+        killTimer(timerId);
+        timerId = 0;
+    }
+}
+
+/*!
+ * Número de elementos programados en esta rueda.
+ */
+int TimerWheel::scheduledCount() const
+{
+    return count;
+}
+
+void TimerWheel::link(Entry *entry, Entry **list)
+{
+    entry->list = list;
+    entry->prev = 0;
+    entry->next = *list;
+    if (*list)
+        (*list)->prev = entry;
+    *list = entry;
+    ++count;
+}
+
+void TimerWheel::unlink(Entry *entry)
+{
+    if (entry->prev)
+        entry->prev->next = entry->next;
+    else
+        *entry->list = entry->next;
+    if (entry->next)
+        entry->next->prev = entry->prev;
+    entry->list = 0;
+    entry->prev = 0;
+    entry->next = 0;
+    --count;
+}
+
+/*!
+ * Avanza la rueda los ticks que hayan pasado (el temporizador puede retrasarse
+ * si el ciclo de eventos estuvo ocupado).
+ */
+void TimerWheel::timerEvent(QTimerEvent *event)
+{
+    if (event->timerId() != timerId) {
+        QObject::timerEvent(event);
+        return;
+    }
+
+    const qint64 ticks = clock.elapsed() / Resolution;
+    while (processedTicks < ticks && count > 0)
+        advance();
+    processedTicks = ticks;
+
+    if (!count && timerId) {
+        killTimer(timerId);
+        timerId = 0;
+    }
+}
+
+/*!
+ * Procesa la siguiente casilla: los elementos con vueltas pendientes se quedan y
+ * los demás vencen. Se pasan primero a una lista aparte porque timeout() puede
+ * reprogramar o cancelar cualquier elemento.
+ */
+void TimerWheel::advance()
+{
+    ++processedTicks;
+    current = (current + 1) % SlotCount;
+
+    Entry *entry = buckets[current];
+    while (entry) {
+        Entry *next = entry->next;
+        if (entry->rounds > 0) {
+            --entry->rounds;
+        } else {
+            unlink(entry);
+            link(entry, &expiring);
+        }
+        entry = next;
+    }
+
+    while (expiring) {
+        entry = expiring;
+        unlink(entry);
+        entry->wheel = 0;
+        entry->timeout();
+    }
+}
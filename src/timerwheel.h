@@ -0,0 +1,71 @@
+#ifndef TIMERWHEEL_H
+#define TIMERWHEEL_H
+
+#include <QElapsedTimer>
+#include <QObject>
+#include <QVector>
+
+/*
+ * Rueda de temporizadores (hashed timing wheel), una por hilo con ciclo de eventos.
+ * Todas las conexiones del hilo comparten un solo temporizador del sistema que
+ * avanza la rueda cada Resolution ms; programar y cancelar son O(1) y mientras
+ * no hay nada programado el temporizador está apagado.
+ */
+class TimerWheel : public QObject
+{
+    Q_OBJECT
+
+public:
+    /* Elemento programable. Quien lo hereda recibe timeout() al vencer su plazo. */
+    class Entry
+    {
+    public:
+        Entry();
+        virtual ~Entry();
+
+        bool isScheduled() const;
+
+    protected:
+        virtual void timeout() = 0;
+
+    private:
+        friend class TimerWheel;
+        TimerWheel *wheel;
+        Entry **list;
+        Entry *prev;
+        Entry *next;
+        int rounds;
+    };
+
+    static const int Resolution = 250;
+    static const int SlotCount = 256;
+
+    ~TimerWheel();
+
+    static TimerWheel *instance();
+
+    qint64 now() const;
+    void schedule(Entry *entry, qint64 delay);
+    void cancel(Entry *entry);
+    int scheduledCount() const;
+
+protected:
+    void timerEvent(QTimerEvent *event);
+
+private:
+    TimerWheel();
+
+    void link(Entry *entry, Entry **list);
+    void unlink(Entry *entry);
+    void advance();
+
+    QVector<Entry *> buckets;
+    Entry *expiring;
+    QElapsedTimer clock;
+    qint64 processedTicks;
+    int current;
+    int count;
+    int timerId;
+};
+
+#endif